@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../src/compiler.hpp"
+#include "../src/lexer.hpp"
+#include "generator.hpp"
+
+// the stages reported, lex is timed on its own, the rest come from the compiler's pass timers
+static const char* stages[] = { "lex", "load", "parse", "resolve", "encode", "format", "write", "total" };
+
+struct Summary {
+    double median_ = 0;
+    double min_ = 0;
+    double max_ = 0;
+
+    // median absolute deviation relative to the median, in percent
+    double spread_ = 0;
+};
+
+static Summary summarize(std::vector<double> samples) {
+    Summary summary;
+
+    if (samples.empty()) {
+        return summary;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    const size_t middle = samples.size() / 2;
+    summary.median_ = samples.size() % 2 ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2;
+    summary.min_ = samples.front();
+    summary.max_ = samples.back();
+
+    std::vector<double> deviations;
+
+    for (const double sample : samples) {
+        deviations.push_back(std::abs(sample - summary.median_));
+    }
+
+    std::sort(deviations.begin(), deviations.end());
+
+    if (summary.median_ > 0) {
+        summary.spread_ = deviations[deviations.size() / 2] * 100 / summary.median_;
+    }
+
+    return summary;
+}
+
+static double lex_seconds(const std::string& source) {
+    Lexer lexer { source };
+    LexToken token;
+    size_t operands = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    while (lexer.next(token)) {
+        operands += token.operand_count_;
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // keeps the loop from being optimized away
+    if (operands == static_cast<size_t>(-1)) {
+        std::cout << "";
+    }
+
+    return elapsed.count();
+}
+
+static void print_usage(const char* name) {
+    std::cout << "Usage: " << name << " <options?>" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --sizes <list>   program sizes in lines (default 1000,10000,100000,1000000,10000000)" << std::endl;
+    std::cout << "  --runs <n>       measured runs per size after one warm up run (default 5)" << std::endl;
+    std::cout << "  --type <type>    D8, S8 or S16 (default D8)" << std::endl;
+    std::cout << "  --seed <n>       generator seed (default 1)" << std::endl;
+    std::cout << "  --mix <list>     instruction weights, as for spl_gen" << std::endl;
+    std::cout << "  --csv            one line per size and stage, for comparing commits" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = { 1000, 10000, 100000, 1000000, 10000000 };
+    int runs = 5;
+    bool csv = false;
+    std::string type = "D8";
+    GeneratorOptions generator;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        std::string error;
+
+        if (arg == "--sizes" && i + 1 < argc) {
+            std::istringstream list { argv[++i] };
+            std::string size;
+            sizes.clear();
+
+            while (std::getline(list, size, ',')) {
+                if (!parse_count(size, sizes.emplace_back())) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            }
+        } else if (arg == "--runs" && i + 1 < argc) {
+            if (!parse_count(argv[++i], runs)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+
+            runs = std::max(1, runs);
+        } else if (arg == "--type" && i + 1 < argc) {
+            type = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            if (!parse_count(argv[++i], generator.seed_)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--mix" && i + 1 < argc) {
+            if (!parse_mix(argv[++i], generator, error)) {
+                std::cout << error << std::endl;
+                return 1;
+            }
+        } else if (arg == "--csv") {
+            csv = true;
+        } else {
+            print_usage(argv[0]);
+            return arg == "-h" ? 0 : 1;
+        }
+    }
+
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / ("spl_bench_" + std::to_string(getpid()));
+    std::filesystem::create_directories(directory);
+
+    const std::string input = (directory / "bench.spl").string();
+
+    if (csv) {
+        std::cout << "lines,stage,median_ms,min_ms,max_ms,spread_percent,lines_per_s" << '\n';
+    } else {
+        std::cout << SPLC_VERSION << ", " << type << ", median of " << runs << " runs after a warm up" << '\n';
+    }
+
+    for (const size_t lines : sizes) {
+        generator.lines_ = lines;
+        const std::string source = generate_program(generator);
+
+        {
+            std::ofstream file { input, std::ios::binary };
+            file << source;
+        }
+
+        std::map<std::string, std::vector<double>> samples;
+        size_t words = 0;
+
+        for (int run = -1; run < runs; ++run) {
+            const double lexing = lex_seconds(source);
+
+            CompileStats stats;
+            SCompiler compiler;
+            compiler.set_output(type);
+            compiler.set_stats(&stats);
+
+            CacheEntry output;
+            const CompileResult result = compiler.compile_output(input, output);
+
+            FileSink sink { directory.string() };
+            std::string failed;
+
+            if (!result.ok_ || !compiler.write_output(output, sink, failed)) {
+                std::cout << "compile failed for " << lines << " lines" << '\n';
+
+                for (const Diagnostic& diagnostic : result.diagnostics_) {
+                    std::cout << diagnostic.message_ << '\n';
+                }
+
+                std::filesystem::remove_all(directory);
+                return 1;
+            }
+
+            words = result.words_.size();
+
+            // the first run fills caches and the allocator, it is not counted
+            if (run < 0) {
+                continue;
+            }
+
+            double total = 0;
+            samples["lex"].push_back(lexing);
+
+            for (const PassTime& pass : stats.passes_) {
+                samples[pass.name_].push_back(pass.seconds_);
+                total += pass.seconds_;
+            }
+
+            samples["total"].push_back(total);
+        }
+
+        if (!csv) {
+            std::cout << '\n' << lines << " lines, " << source.size() / 1024 << " KB, " << words << " words" << '\n';
+            std::cout << std::left << std::setw(10) << "stage" << std::right << std::setw(12) << "median ms" << std::setw(12) << "min ms"
+                      << std::setw(12) << "max ms" << std::setw(10) << "spread" << std::setw(14) << "Mlines/s" << std::setw(10) << "MB/s" << '\n';
+        }
+
+        for (const char* stage : stages) {
+            const Summary summary = summarize(samples[stage]);
+            const double lines_per_s = summary.median_ > 0 ? lines / summary.median_ : 0;
+            const double mb_per_s = summary.median_ > 0 ? source.size() / summary.median_ / (1024 * 1024) : 0;
+
+            if (csv) {
+                std::cout << lines << ',' << stage << ',' << summary.median_ * 1000 << ',' << summary.min_ * 1000 << ','
+                          << summary.max_ * 1000 << ',' << summary.spread_ << ',' << lines_per_s << '\n';
+                continue;
+            }
+
+            std::cout << std::left << std::setw(10) << stage << std::right << std::fixed << std::setprecision(3)
+                      << std::setw(12) << summary.median_ * 1000 << std::setw(12) << summary.min_ * 1000 << std::setw(12) << summary.max_ * 1000
+                      << std::setw(9) << std::setprecision(1) << summary.spread_ << '%' << std::setprecision(2)
+                      << std::setw(14) << lines_per_s / 1e6 << std::setw(10) << mb_per_s << '\n' << std::defaultfloat;
+        }
+    }
+
+    std::filesystem::remove_all(directory);
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/encoder.hpp"
+
+// an instruction as parse_tree sees it, operands still in their source form
+struct BenchToken {
+    Instructions type_;
+    Types types_[MAX_OPERANDS];
+    std::string values_[MAX_OPERANDS];
+};
+
+static Word htow(const std::string& hex_value) {
+    return static_cast<Word>(std::stoi(hex_value, 0, 16));
+}
+
+/*
+ * The encoders as they were before the constexpr tables: one heap allocated encoder per
+ * instruction, a virtual call and a hash lookup of every register name.
+ */
+namespace before {
+
+struct LegacyRegister {
+    uint16_t from_bus_;
+    uint16_t to_bus_;
+};
+
+const std::unordered_map<std::string, LegacyRegister> register_codes = {
+    {"a", { A_FROM_BUS, A_TO_BUS }},
+    {"b", { B_FROM_BUS, B_TO_BUS }},
+    {"c", { C_FROM_BUS, C_TO_BUS }},
+    {"acc", { N_ALWD, ACC_TO_BUS }},
+    {"flgs", { N_ALWD, FLGS_TO_BUS }},
+    {"lgc", { N_ALWD, LGC_TO_BUS }},
+};
+
+struct InstructionCode {
+    virtual void get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val, std::vector<Word>& out) = 0;
+    virtual ~InstructionCode() = default;
+};
+
+inline void alu_code(const uint16_t alu, const uint16_t dest, const Types type, const std::string& value, std::vector<Word>& out) {
+    if (type == REG) {
+        out.push_back(make_word(alu, dest, register_codes.at(value).to_bus_, FLAG_NONE));
+    } else if (type == IMM) {
+        out.push_back(make_word(alu, dest, BUS_NONE, FLAG_IMM));
+        out.push_back(htow(value));
+    }
+}
+
+struct MOV_Inst : public InstructionCode {
+    void get_code(const Types /* first */, const Types second, const std::string& first_val, const std::string& second_val, std::vector<Word>& out) override {
+        alu_code(ALU_NONE, register_codes.at(first_val).from_bus_, second, second_val, out);
+    }
+};
+
+struct WR_Inst : public InstructionCode {
+    void get_code(const Types first, const Types /* second */, const std::string& first_val, const std::string& second_val, std::vector<Word>& out) override {
+        alu_code(ALU_NONE, BUS_MAR, first, first_val, out);
+        out.push_back(make_word(ALU_RAM_WR, BUS_WR, register_codes.at(second_val).to_bus_, FLAG_WR));
+    }
+};
+
+struct RD_Inst : public InstructionCode {
+    void get_code(const Types first, const Types /* second */, const std::string& first_val, const std::string& second_val, std::vector<Word>& out) override {
+        alu_code(ALU_NONE, BUS_MAR, first, first_val, out);
+        out.push_back(make_word(ALU_NONE, register_codes.at(second_val).from_bus_, BUS_RAM, FLAG_NONE));
+    }
+};
+
+struct EXEC_Inst : public InstructionCode {
+    void get_code(const Types first, const Types /* second */, const std::string& first_val, const std::string& /* second_val */, std::vector<Word>& out) override {
+        alu_code(ALU_NONE, BUS_MAR, first, first_val, out);
+        out.push_back(make_word(ALU_NONE, BUS_RAM, BUS_RAM, FLAG_NONE));
+    }
+};
+
+template <uint16_t Alu, bool Swapped>
+struct ALU_Inst : public InstructionCode {
+    void get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val, std::vector<Word>& out) override {
+        alu_code(ALU_NONE, BUS_NUMBR, Swapped ? second : first, Swapped ? second_val : first_val, out);
+        alu_code(Alu, BUS_NONE, Swapped ? first : second, Swapped ? first_val : second_val, out);
+    }
+};
+
+template <uint16_t Dest>
+struct JUMP_Inst : public InstructionCode {
+    void get_code(const Types first, const Types /* second */, const std::string& first_val, const std::string& /* second_val */, std::vector<Word>& out) override {
+        alu_code(ALU_NONE, Dest, first, first_val, out);
+    }
+};
+
+struct HLT_Inst : public InstructionCode {
+    void get_code(const Types /* first */, const Types /* second */, const std::string& /* first_val */, const std::string& /* second_val */, std::vector<Word>& out) override {
+        out.push_back(make_word(ALU_NONE, BUS_NONE, BUS_HLT, FLAG_NONE));
+    }
+};
+
+std::shared_ptr<InstructionCode> get_instruction_struct(const Instructions inst) {
+    switch (inst) {
+        case(MOV):
+            return std::make_shared<MOV_Inst>();
+        case(WR):
+            return std::make_shared<WR_Inst>();
+        case(RD):
+            return std::make_shared<RD_Inst>();
+        case(EXEC):
+            return std::make_shared<EXEC_Inst>();
+        case(ADD):
+            return std::make_shared<ALU_Inst<ALU_ADD, false>>();
+        case(SUB):
+            return std::make_shared<ALU_Inst<ALU_SUB, true>>();
+        case(CMP):
+            return std::make_shared<ALU_Inst<ALU_CMP, true>>();
+        case(JMP):
+            return std::make_shared<JUMP_Inst<BUS_PC>>();
+        case(JE):
+            return std::make_shared<JUMP_Inst<BUS_JE>>();
+        case(JNE):
+            return std::make_shared<JUMP_Inst<BUS_JNE>>();
+        default:
+            return std::make_shared<HLT_Inst>();
+    }
+}
+
+void encode_all(const std::vector<BenchToken>& tokens, std::vector<Word>& out) {
+    for (const BenchToken& token : tokens) {
+        get_instruction_struct(token.type_)->get_code(token.types_[0], token.types_[1], token.values_[0], token.values_[1], out);
+    }
+}
+
+}
+
+namespace after {
+
+void encode_all(const std::vector<BenchToken>& tokens, std::vector<Word>& out) {
+    for (const BenchToken& token : tokens) {
+        Operand operands[MAX_OPERANDS];
+
+        for (size_t i = 0; i < MAX_OPERANDS; ++i) {
+            operands[i].type_ = token.types_[i];
+
+            if (token.types_[i] == REG) {
+                operands[i].value_ = static_cast<uint16_t>(find_register(token.values_[i]));
+            } else if (token.types_[i] == IMM) {
+                operands[i].value_ = htow(token.values_[i]);
+            }
+        }
+
+        encode(token.type_, operands, out);
+    }
+}
+
+}
+
+// every instruction with each operand form it accepts
+static std::vector<BenchToken> generate_tokens(const size_t count) {
+    const BenchToken forms[] = {
+        { MOV, { REG, REG }, { "a", "acc" } },
+        { MOV, { REG, IMM }, { "b", "0x1F" } },
+        { WR, { REG, REG }, { "b", "a" } },
+        { WR, { IMM, REG }, { "0x10", "c" } },
+        { RD, { IMM, REG }, { "0x10", "c" } },
+        { RD, { REG, REG }, { "a", "b" } },
+        { EXEC, { REG, NONE }, { "a", "" } },
+        { ADD, { REG, IMM }, { "a", "0x1" } },
+        { ADD, { REG, REG }, { "flgs", "b" } },
+        { SUB, { IMM, REG }, { "0xFF", "b" } },
+        { CMP, { REG, REG }, { "a", "lgc" } },
+        { JMP, { IMM, NONE }, { "0x4", "" } },
+        { JE, { REG, NONE }, { "c", "" } },
+        { JNE, { IMM, NONE }, { "0x1F", "" } },
+        { HLT, { NONE, NONE }, { "", "" } },
+    };
+
+    std::vector<BenchToken> tokens;
+    tokens.reserve(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        tokens.push_back(forms[i % (sizeof(forms) / sizeof(forms[0]))]);
+    }
+
+    return tokens;
+}
+
+// best time of runs in nanoseconds per instruction, words is the output of the last run
+template <typename Function>
+static double measure(Function encode_all, const std::vector<BenchToken>& tokens, const int runs, std::vector<Word>& words) {
+    double best = 0;
+
+    for (int run = 0; run < runs; ++run) {
+        words.clear();
+
+        const auto start = std::chrono::steady_clock::now();
+        encode_all(tokens, words);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        const double ns = elapsed.count() * 1e9 / tokens.size();
+
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+    }
+
+    return best;
+}
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? std::stoul(argv[1]) : 2000000;
+    const int runs = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    const std::vector<BenchToken> tokens = generate_tokens(count);
+
+    std::vector<Word> before_words;
+    std::vector<Word> after_words;
+    before_words.reserve(count * 4);
+    after_words.reserve(count * 4);
+
+    const double before_ns = measure(before::encode_all, tokens, runs, before_words);
+    const double after_ns = measure(after::encode_all, tokens, runs, after_words);
+
+    if (before_words != after_words) {
+        std::cout << "encoders disagree" << '\n';
+        return 1;
+    }
+
+    std::cout << "instructions: " << count << ", words: " << after_words.size() << '\n';
+    std::cout << "shared_ptr + virtual: " << before_ns << " ns/instruction (best of " << runs << ")" << '\n';
+    std::cout << "constexpr tables: " << after_ns << " ns/instruction (best of " << runs << ")" << '\n';
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "../src/encoder.hpp"
+
+struct GeneratorOptions {
+    size_t lines_ = 1000;
+    uint32_t seed_ = 1;
+
+    // relative weight of each instruction, indexed by Instructions
+    uint32_t weights_[HLT + 1] = { 4, 2, 2, 1, 3, 3, 1, 2, 1, 1, 1 };
+
+    // chance in percent that a register or immediate operand is a register
+    uint32_t register_percent_ = 50;
+
+    // a label is put before every label_every_ instructions, 0 for none
+    size_t label_every_ = 16;
+};
+
+// the whole text has to be a decimal number
+template <typename T>
+inline bool parse_count(std::string_view text, T& out) {
+    const char* end = text.data() + text.size();
+    const auto [last, error] = std::from_chars(text.data(), end, out);
+
+    return error == std::errc() && last == end && !text.empty();
+}
+
+// "mov=4,exec=0" sets the weights it names and leaves the others alone
+inline bool parse_mix(const std::string& text, GeneratorOptions& options, std::string& error) {
+    std::istringstream items { text };
+    std::string item;
+
+    while (std::getline(items, item, ',')) {
+        const size_t equals = item.find('=');
+        const InstructionInfo* inst = find_instruction(item.substr(0, equals));
+
+        if (equals == std::string::npos || inst == nullptr || !parse_count(std::string_view(item).substr(equals + 1), options.weights_[inst->type_])) {
+            error = "Invalid mix entry: " + item;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Valid SPL with every instruction and both operand forms, one instruction per line. Labels are
+ * only placed while their address fits in an immediate, later jumps go back to earlier labels.
+ */
+inline std::string generate_program(const GeneratorOptions& options) {
+    static const char* writable[] = { "a", "b", "c" };
+    static const char* readable[] = { "a", "b", "c", "acc", "flgs", "lgc" };
+
+    std::mt19937 rng { options.seed_ };
+
+    uint32_t total_weight = 0;
+
+    for (const uint32_t weight : options.weights_) {
+        total_weight += weight;
+    }
+
+    std::string source;
+    source.reserve(options.lines_ * 12);
+
+    size_t labels = 0;
+    uint32_t address = 0;
+
+    // a jump went forward to the next label, which has to be placed
+    bool pending = false;
+
+    // jumps can go forward to the next label while it still fits in an immediate
+    const uint32_t label_limit = 0x10000 - static_cast<uint32_t>(options.label_every_) * 4 - 4;
+
+    for (size_t line = 0; line < options.lines_; ++line) {
+        const bool labelling = options.label_every_ != 0 && address < label_limit;
+
+        if ((labelling && line % options.label_every_ == 0) || (!labelling && pending)) {
+            source += "l" + std::to_string(labels++) + ": ";
+            pending = false;
+        }
+
+        uint32_t pick = total_weight == 0 ? static_cast<uint32_t>(HLT) : rng() % total_weight;
+        int inst = 0;
+
+        while (inst < HLT && pick >= options.weights_[inst]) {
+            pick -= options.weights_[inst];
+            ++inst;
+        }
+
+        const InstructionInfo& info = instruction_table[inst];
+        const bool jump = inst == JMP || inst == JE || inst == JNE;
+        Types kinds[MAX_OPERANDS] = { NONE, NONE };
+
+        source += info.name_;
+
+        for (int i = 0; i < info.children_; ++i) {
+            const Types expected = info.child_types_[i];
+            const bool reg = expected == REG || (expected == REG_IMM && rng() % 100 < options.register_percent_);
+
+            source += i == 0 ? " " : ", ";
+
+            if (reg) {
+                // mov and rd write their register operand
+                const bool writes = (inst == MOV && i == 0) || (inst == RD && i == 1);
+                source += writes ? writable[rng() % 3] : readable[rng() % 6];
+                kinds[i] = REG;
+                continue;
+            }
+
+            kinds[i] = IMM;
+
+            if (jump && labels != 0 && (labelling || rng() % 2 == 0)) {
+                // the current label, an earlier one, or the next one when labels are still placed
+                const size_t target = labelling && rng() % 4 == 0 ? labels : rng() % labels;
+                pending = pending || target == labels;
+                source += "l" + std::to_string(target);
+            } else {
+                char hex[8];
+                snprintf(hex, sizeof(hex), "0x%X", static_cast<unsigned>(rng() & 0xFFFF));
+                source += hex;
+            }
+        }
+
+        source += '\n';
+        address += instruction_size(static_cast<Instructions>(inst), kinds[0], kinds[1]);
+    }
+
+    // labels were still placed at the last line, so this is in range too
+    if (pending) {
+        source += "l" + std::to_string(labels) + ":\n";
+    }
+
+    return source;
+}
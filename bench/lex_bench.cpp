@@ -0,0 +1,75 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../src/lexer.hpp"
+
+// builds a program of roughly target_size bytes out of every instruction form
+static std::string generate_source(const size_t target_size) {
+    const char* lines[] = {
+        "mov a, 0x0",
+        "mov b, acc",
+        "wr b, a",
+        "rd 0x10, c",
+        "exec a",
+        "add a, 0x1",
+        "sub 0xFF, b",
+        "cmp a, b",
+        "jmp 0x4",
+        "je c",
+        "jne 0x1F",
+        "hlt",
+        "",
+    };
+
+    std::string source;
+    source.reserve(target_size + 64);
+
+    size_t i = 0;
+
+    while (source.size() < target_size) {
+        source += lines[i % (sizeof(lines) / sizeof(lines[0]))];
+        source += '\n';
+        ++i;
+    }
+
+    return source;
+}
+
+int main(int argc, char** argv) {
+    const size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 64;
+    const int runs = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    const std::string source = generate_source(megabytes * 1024 * 1024);
+
+    double best = 0;
+    size_t tokens = 0;
+
+    for (int run = 0; run < runs; ++run) {
+        Lexer lexer { source };
+        LexToken token;
+        size_t count = 0;
+        size_t operands = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        while (lexer.next(token)) {
+            operands += token.operand_count_;
+            ++count;
+        }
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        const double mb_per_s = (source.size() / (1024.0 * 1024.0)) / elapsed.count();
+
+        if (mb_per_s > best) {
+            best = mb_per_s;
+        }
+
+        tokens = count + operands;
+    }
+
+    std::cout << "source: " << source.size() / (1024 * 1024) << " MB, tokens: " << tokens << '\n';
+    std::cout << "lexing: " << best << " MB/s (best of " << runs << ")" << '\n';
+
+    return 0;
+}
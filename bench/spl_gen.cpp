@@ -0,0 +1,64 @@
+#include <iostream>
+#include <string>
+
+#include "generator.hpp"
+
+static void print_usage(const char* name) {
+    std::cout << "Usage: " << name << " <lines> <options?>" << std::endl;
+    std::cout << "Writes a valid synthetic SPL program to standard output" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --seed <n>        random seed (default 1)" << std::endl;
+    std::cout << "  --mix <list>      instruction weights, e.g. mov=4,exec=0 (default mov=4,wr=2,rd=2,exec=1,add=3,sub=3,jmp=1,cmp=2,je=1,jne=1,hlt=1)" << std::endl;
+    std::cout << "  --registers <n>   percent of register or immediate operands that are registers (default 50)" << std::endl;
+    std::cout << "  --labels <n>      put a label before every n instructions, 0 for none (default 16)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || std::string(argv[1]) == "-h") {
+        print_usage(argv[0]);
+        return argc < 2 ? 1 : 0;
+    }
+
+    GeneratorOptions options;
+
+    if (!parse_count(argv[1], options.lines_)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i += 2) {
+        const std::string arg = argv[i];
+        std::string error;
+        bool valid = true;
+
+        // every option takes a value
+        if (i + 1 == argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        if (arg == "--seed") {
+            valid = parse_count(argv[i + 1], options.seed_);
+        } else if (arg == "--mix") {
+            if (!parse_mix(argv[i + 1], options, error)) {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+        } else if (arg == "--registers") {
+            valid = parse_count(argv[i + 1], options.register_percent_);
+        } else if (arg == "--labels") {
+            valid = parse_count(argv[i + 1], options.label_every_);
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::cout << generate_program(options);
+
+    return 0;
+}
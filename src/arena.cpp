@@ -0,0 +1,54 @@
+#include "arena.hpp"
+
+#include <cstdint>
+
+void* Arena::allocate_bytes(const size_t size, const size_t alignment) {
+    const size_t padding = (alignment - reinterpret_cast<uintptr_t>(next_) % alignment) % alignment;
+
+    if (next_ == nullptr || padding + size > left_) {
+        // new blocks come from operator new, which aligns for any fundamental type
+        const size_t block_size = size > ARENA_BLOCK_SIZE / 4 ? size : ARENA_BLOCK_SIZE;
+
+        blocks_.push_back({ std::make_unique_for_overwrite<std::byte[]>(block_size), block_size });
+        allocated_ += block_size;
+
+        // an oversized block is used up at once, keep bumping through the last shared block
+        if (block_size != ARENA_BLOCK_SIZE) {
+            return blocks_.back().data_.get();
+        }
+
+        next_ = blocks_.back().data_.get();
+        left_ = block_size;
+
+        return allocate_bytes(size, alignment);
+    }
+
+    void* memory = next_ + padding;
+    next_ += padding + size;
+    left_ -= padding + size;
+
+    return memory;
+}
+
+void Arena::reset() {
+    std::unique_ptr<std::byte[]> kept;
+
+    for (Block& block : blocks_) {
+        if (block.size_ == ARENA_BLOCK_SIZE) {
+            kept = std::move(block.data_);
+            break;
+        }
+    }
+
+    blocks_.clear();
+    next_ = nullptr;
+    left_ = 0;
+    allocated_ = 0;
+
+    if (kept) {
+        blocks_.push_back({ std::move(kept), ARENA_BLOCK_SIZE });
+        next_ = blocks_.back().data_.get();
+        left_ = ARENA_BLOCK_SIZE;
+        allocated_ = ARENA_BLOCK_SIZE;
+    }
+}
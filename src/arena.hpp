@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// allocations smaller than this share a block, larger ones get a block of their own
+constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+/*
+ * Bump allocator for data that lives as long as its owner. Nothing is freed on its own, every
+ * block goes at once when the arena is reset or destroyed, so only trivially destructible
+ * types can be allocated.
+ */
+class Arena {
+    private:
+        struct Block {
+            std::unique_ptr<std::byte[]> data_;
+            size_t size_;
+        };
+
+        std::vector<Block> blocks_;
+        std::byte* next_ = nullptr;
+        size_t left_ = 0;
+        size_t allocated_ = 0;
+
+        void* allocate_bytes(size_t size, size_t alignment);
+
+    public:
+        Arena() = default;
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        template <typename T>
+        T* allocate(const size_t count) {
+            static_assert(std::is_trivially_destructible_v<T>, "arena memory is never destroyed");
+            return static_cast<T*>(allocate_bytes(count * sizeof(T), alignof(T)));
+        }
+
+        // frees everything but one shared block, so an arena reused for small inputs stops allocating
+        void reset();
+
+        // bytes held from the system
+        size_t allocated() const {
+            return allocated_;
+        }
+
+        ~Arena() = default;
+};
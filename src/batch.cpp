@@ -0,0 +1,171 @@
+#include "batch.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "compiler.hpp"
+#include "thread_pool.hpp"
+
+BatchJob make_job(const std::string& input, const std::string& output_dir) {
+    std::filesystem::path output { input };
+    output.replace_extension();
+
+    if (!output_dir.empty()) {
+        output = std::filesystem::path(output_dir) / output.filename();
+    }
+
+    return { input, output.string() };
+}
+
+bool read_manifest(const std::string& file_name, const std::string& output_dir, std::vector<BatchJob>& jobs, std::string& error) {
+    std::ifstream file { file_name };
+
+    if (!file.is_open()) {
+        error = "Manifest not found: " + file_name;
+        return false;
+    }
+
+    std::string line;
+    size_t number = 0;
+
+    while (std::getline(file, line)) {
+        ++number;
+
+        std::istringstream fields { line };
+        std::string input;
+        std::string output;
+        std::string extra;
+
+        if (!(fields >> input) || input[0] == '#') {
+            continue;
+        }
+
+        BatchJob job = make_job(input, output_dir);
+
+        if (fields >> output) {
+            job.output_ = output;
+        }
+
+        if (fields >> extra) {
+            error = "Invalid manifest line " + std::to_string(number) + ": " + line;
+            return false;
+        }
+
+        jobs.push_back(job);
+    }
+
+    return true;
+}
+
+// what happened to one job, filled in by the worker that ran it
+struct JobOutcome {
+    bool ok_ = false;
+    size_t source_bytes_ = 0;
+    size_t words_ = 0;
+    std::vector<std::string> messages_;
+    CompileStats stats_;
+};
+
+static void run_job(const BatchJob& job, const BatchOptions& options, JobOutcome& outcome) {
+    SCompiler compiler;
+    compiler.set_optimize(options.optimize_);
+    compiler.set_object(options.object_);
+    compiler.set_line_map(options.line_map_);
+    compiler.set_cache(options.cache_);
+    compiler.set_output(options.output_type_);
+    compiler.set_format(options.format_);
+
+    if (options.stats_ != nullptr) {
+        compiler.set_stats(&outcome.stats_);
+    }
+
+    CacheEntry output;
+    const CompileResult result = compiler.compile_output(job.input_, output);
+
+    for (const Diagnostic& diagnostic : result.diagnostics_) {
+        outcome.messages_.push_back(diagnostic.message_);
+    }
+
+    if (!result.ok_) {
+        return;
+    }
+
+    std::error_code ignored;
+    outcome.source_bytes_ = std::filesystem::file_size(job.input_, ignored);
+    outcome.words_ = result.words_.size();
+
+    FileSink sink { "", job.output_ };
+    std::string failed;
+
+    if (!compiler.write_output(output, sink, failed)) {
+        outcome.messages_.push_back("Failed to open output file: " + sink.path(failed));
+        return;
+    }
+
+    outcome.ok_ = true;
+}
+
+size_t run_batch(const std::vector<BatchJob>& jobs, const BatchOptions& options, std::ostream& log) {
+    std::vector<JobOutcome> outcomes(jobs.size());
+
+    const auto start = std::chrono::steady_clock::now();
+    size_t threads;
+
+    {
+        ThreadPool pool { options.threads_ };
+        threads = pool.size();
+
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            pool.submit([&, i] { run_job(jobs[i], options, outcomes[i]); });
+        }
+
+        pool.wait();
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    size_t failed = 0;
+    size_t bytes = 0;
+    size_t words = 0;
+
+    // reported in manifest order once everything is done, so the log does not depend on scheduling
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const JobOutcome& outcome = outcomes[i];
+
+        for (const std::string& message : outcome.messages_) {
+            log << jobs[i].input_ << ": " << message << '\n';
+        }
+
+        if (!outcome.ok_) {
+            ++failed;
+            log << jobs[i].input_ << ": failed" << '\n';
+        }
+
+        bytes += outcome.source_bytes_;
+        words += outcome.words_;
+
+        if (options.stats_ != nullptr) {
+            options.stats_->add(outcome.stats_);
+        }
+    }
+
+    const double seconds = elapsed.count();
+
+    log << "batch: " << jobs.size() << " files, " << failed << " failed, " << words << " words in "
+        << seconds * 1000 << " ms on " << threads << " threads";
+
+    if (seconds > 0) {
+        log << " (" << jobs.size() / seconds << " files/s, " << bytes / seconds / (1024 * 1024) << " MB/s of source)";
+    }
+
+    log << '\n';
+
+    if (options.cache_ != nullptr) {
+        const CacheStats stats = options.cache_->stats();
+        log << "cache: " << stats.hits_ << " hits, " << stats.misses_ << " misses" << '\n';
+    }
+
+    return failed;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "cache.hpp"
+#include "isa.hpp"
+#include "output.hpp"
+#include "stats.hpp"
+
+struct BatchJob {
+    std::string input_;
+
+    // path the outputs are named after, "build/prog" writes build/prog.hex (and build/prog.map)
+    std::string output_;
+};
+
+struct BatchOptions {
+    OutputTypes output_type_ = HALF_DUAL_WORD;
+    OutputFormats format_ = FORMAT_RAW;
+    bool optimize_ = false;
+    bool line_map_ = false;
+
+    // write <name>.o objects for the linker instead of images
+    bool object_ = false;
+
+    // 0 uses every core
+    size_t threads_ = 0;
+
+    // shared by every worker, nullptr compiles everything
+    CompileCache* cache_ = nullptr;
+
+    // the stats of every job are added to it once the batch is done, nullptr collects nothing
+    CompileStats* stats_ = nullptr;
+};
+
+// input with its extension dropped, placed in output_dir when one is given
+BatchJob make_job(const std::string& input, const std::string& output_dir);
+
+/*
+ * Manifest files list one job per line: the input and optionally the output base. Blank lines
+ * and lines starting with # are skipped, relative paths are taken as they are written.
+ */
+bool read_manifest(const std::string& file_name, const std::string& output_dir, std::vector<BatchJob>& jobs, std::string& error);
+
+// compiles every job on a thread pool, prints failures and a summary to log, returns the number of failed jobs
+size_t run_batch(const std::vector<BatchJob>& jobs, const BatchOptions& options, std::ostream& log);
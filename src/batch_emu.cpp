@@ -0,0 +1,629 @@
+#include "batch_emu.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#include "thread_pool.hpp"
+
+// the lane loops are built for plain x86-64 and again for avx2, picked when the program starts. flatten
+// inlines the lambdas into both copies, otherwise they are called out of the avx2 copy built for plain x86-64
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__clang__)
+#define SPL_LANE_CLONES __attribute__((flatten, target_clones("avx2", "default")))
+#else
+#define SPL_LANE_CLONES
+#endif
+
+using LaneMask = uint64_t;
+
+static_assert(BATCH_LANES == 64, "a lane mask holds one bit per lane");
+
+constexpr LaneMask ALL_LANES = ~LaneMask(0);
+
+// names of the register file in vector files, pc only takes expected values
+static const char* vector_register_names[R_COUNT + 1] = { "a", "b", "c", "acc", "flgs", "lgc", "numbr", "mar", "cbus_cache", "pc" };
+
+// 0x for hex, decimal otherwise
+static bool parse_number(const std::string& text, const uint32_t limit, uint32_t& out) {
+    const bool hex = text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X');
+    const std::string digits = hex ? text.substr(2) : text;
+
+    if (digits.empty() || digits.size() > 8) {
+        return false;
+    }
+
+    for (const char digit : digits) {
+        if (hex ? !isxdigit(static_cast<unsigned char>(digit)) : !isdigit(static_cast<unsigned char>(digit))) {
+            return false;
+        }
+    }
+
+    const unsigned long value = std::stoul(digits, nullptr, hex ? 16 : 10);
+
+    if (value > limit) {
+        return false;
+    }
+
+    out = static_cast<uint32_t>(value);
+
+    return true;
+}
+
+// one reg=value or @address=value,value,... token, into the initial or the expected values
+static bool parse_assignment(const std::string& token, const bool expected, TestVector& vector) {
+    const size_t equals = token.find('=');
+
+    if (equals == std::string::npos || equals == 0) {
+        return false;
+    }
+
+    const std::string name = token.substr(0, equals);
+    const std::string values = token.substr(equals + 1);
+    uint32_t value = 0;
+
+    if (name[0] != '@') {
+        const uint8_t count = expected ? R_COUNT + 1 : R_COUNT;
+
+        for (uint8_t reg = 0; reg < count; ++reg) {
+            if (name == vector_register_names[reg]) {
+                if (!parse_number(values, 0xFFFF, value)) {
+                    return false;
+                }
+
+                (expected ? vector.expected_registers_ : vector.registers_).push_back({ reg, static_cast<uint16_t>(value) });
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    uint32_t address = 0;
+
+    if (!parse_number(name.substr(1), RAM_WORDS - 1, address)) {
+        return false;
+    }
+
+    std::stringstream stream { values };
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+        if (address >= RAM_WORDS || !parse_number(item, 0xFFFF, value)) {
+            return false;
+        }
+
+        (expected ? vector.expected_ram_ : vector.ram_).push_back({ static_cast<uint16_t>(address++), static_cast<uint16_t>(value) });
+    }
+
+    return !values.empty() && values.back() != ',';
+}
+
+bool read_vectors(const std::string& file_name, std::vector<TestVector>& vectors, std::string& error) {
+    std::ifstream file { file_name };
+
+    if (!file.is_open()) {
+        error = "File not found: " + file_name;
+        return false;
+    }
+
+    std::string line;
+
+    for (uint32_t number = 1; std::getline(file, line); ++number) {
+        // everything after # is a comment
+        std::stringstream stream { line.substr(0, line.find('#')) };
+        std::string token;
+
+        TestVector vector;
+        vector.line_ = number;
+
+        bool empty = true;
+        bool expected = false;
+
+        while (stream >> token) {
+            empty = false;
+
+            if (token == "=>" && !expected) {
+                expected = true;
+            } else if (!parse_assignment(token, expected, vector)) {
+                error = "Invalid test vector: " + file_name + ", line " + std::to_string(number) + ": " + token;
+                return false;
+            }
+        }
+
+        if (!empty) {
+            vectors.push_back(std::move(vector));
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Up to BATCH_LANES instances as structure of arrays. Ram is interleaved by lane, word w of lane
+ * i is ram_[w * BATCH_LANES + i], so a lane can be handed to Emulator::execute_word with a
+ * stride and lanes reading the same address touch the same cache line.
+ */
+struct LaneGroup {
+    alignas(64) uint16_t regs_[R_COUNT][BATCH_LANES] {};
+    uint32_t pc_[BATCH_LANES] {};
+    uint64_t cycles_[BATCH_LANES] {};
+    HaltReasons reason_[BATCH_LANES] {};
+    Word bad_word_[BATCH_LANES] {};
+
+    std::vector<uint16_t> ram_ = std::vector<uint16_t>(RAM_WORDS * BATCH_LANES, 0);
+
+    // back to all zero without giving up the ram
+    void clear() {
+        std::fill(&regs_[0][0], &regs_[0][0] + R_COUNT * BATCH_LANES, 0);
+        std::fill(pc_, pc_ + BATCH_LANES, 0);
+        std::fill(cycles_, cycles_ + BATCH_LANES, 0);
+        std::fill(reason_, reason_ + BATCH_LANES, running);
+        std::fill(bad_word_, bad_word_ + BATCH_LANES, 0);
+        std::fill(ram_.begin(), ram_.end(), 0);
+    }
+};
+
+// counters of one group, added to the report once it is done
+struct GroupStats {
+    uint64_t lane_steps_ = 0;
+    uint64_t lockstep_steps_ = 0;
+    std::map<uint32_t, uint64_t> splits_;
+};
+
+/*
+ * Runs f for every lane in mask. With every lane set it is a plain loop the compiler can
+ * vectorize, otherwise only the set bits are visited.
+ */
+template <typename F>
+static inline void for_lanes(const LaneMask mask, F&& f) {
+    if (mask == ALL_LANES) {
+        for (size_t lane = 0; lane < BATCH_LANES; ++lane) {
+            f(lane);
+        }
+
+        return;
+    }
+
+    for (LaneMask bits = mask; bits != 0; bits &= bits - 1) {
+        f(static_cast<size_t>(std::countr_zero(bits)));
+    }
+}
+
+/*
+ * Runs the lanes of a group until every one has stopped. Values move through local arrays
+ * instead of straight from one register row to another: the rows are picked at run time and
+ * could be the same, and a loop that needs an alias check is not vectorized at -O2.
+ */
+SPL_LANE_CLONES static void run_group(LaneGroup& group, const LaneMask lanes, const std::vector<DecodedOp>& decoded, const uint32_t end, const uint64_t max_cycles, GroupStats& stats) {
+    const DecodedOp* ops = decoded.data();
+
+    uint16_t (&regs)[R_COUNT][BATCH_LANES] = group.regs_;
+    uint32_t* const pcs = group.pc_;
+    uint64_t* const cycles = group.cycles_;
+    uint16_t* const ram = group.ram_.data();
+
+    LaneMask active = lanes;
+
+    // set once lanes stop sharing a pc, until they all meet again
+    bool split = false;
+
+    // no instruction adds more than 3 cycles, so no lane can reach the limit for this many more steps
+    uint64_t safe_steps = 0;
+
+    auto stop = [&](const size_t lane, const HaltReasons reason) {
+        group.reason_[lane] = reason;
+        active &= ~(LaneMask(1) << lane);
+    };
+
+    // cycles and pcs are stepped in loops of their own, a loop writing both would need an alias check and not vectorize
+    auto advance = [&](const LaneMask mask, const uint32_t words) {
+        for_lanes(mask, [&](const size_t lane) { cycles[lane] += words; });
+        for_lanes(mask, [&](const size_t lane) { pcs[lane] += words; });
+    };
+
+    // acc, flgs and lgc of an add (or sub and cmp) for every lane in mask, each with alu as a constant so the loop has no branch left
+    auto alu_lanes = [&](const LaneMask mask, const bool add, const uint16_t* value) {
+        uint16_t acc[BATCH_LANES];
+        uint16_t flgs[BATCH_LANES];
+        uint16_t lgc[BATCH_LANES];
+
+        const uint16_t* numbr = regs[R_NUMBR];
+
+        auto alu = [&](const size_t lane, const AluResult& result) {
+            acc[lane] = result.acc_;
+            flgs[lane] = result.flgs_;
+            lgc[lane] = result.lgc_;
+        };
+
+        if (add) {
+            for_lanes(mask, [&](const size_t lane) { alu(lane, alu_result(ALU_ADD, numbr[lane], value[lane])); });
+        } else {
+            for_lanes(mask, [&](const size_t lane) { alu(lane, alu_result(ALU_SUB, numbr[lane], value[lane])); });
+        }
+
+        for_lanes(mask, [&](const size_t lane) { regs[R_ACC][lane] = acc[lane]; });
+        for_lanes(mask, [&](const size_t lane) { regs[R_FLGS][lane] = flgs[lane]; });
+        for_lanes(mask, [&](const size_t lane) { regs[R_LGC][lane] = lgc[lane]; });
+    };
+
+    // one lane through the slow path, returns halted after a hlt and invalid_word when the word stopped the lane
+    auto execute = [&](const size_t lane, const Word word, const Word imm, uint32_t& next_pc) {
+        uint16_t lane_regs[R_COUNT];
+        HaltReasons reason = running;
+
+        for (size_t reg = 0; reg < R_COUNT; ++reg) {
+            lane_regs[reg] = regs[reg][lane];
+        }
+
+        const bool valid = Emulator::execute_word(lane_regs, ram + lane, BATCH_LANES, end, word, imm, next_pc, reason);
+
+        for (size_t reg = 0; reg < R_COUNT; ++reg) {
+            regs[reg][lane] = lane_regs[reg];
+        }
+
+        if (!valid) {
+            group.bad_word_[lane] = word;
+            stop(lane, invalid_word);
+        }
+
+        return valid ? reason : invalid_word;
+    };
+
+    while (active != 0) {
+        if (safe_steps == 0) {
+            uint64_t most = 0;
+
+            for_lanes(active, [&](const size_t lane) {
+                if (cycles[lane] >= max_cycles) {
+                    stop(lane, cycle_limit);
+                } else {
+                    most = cycles[lane] > most ? cycles[lane] : most;
+                }
+            });
+
+            if (active == 0) {
+                break;
+            }
+
+            safe_steps = (max_cycles - 1 - most) / 3 + 1;
+        }
+
+        --safe_steps;
+
+        LaneMask mask = active;
+        uint32_t pc = pcs[std::countr_zero(active)];
+
+        // the lanes furthest behind go first, so the rest wait for them where the paths join
+        if (split) {
+            for_lanes(active, [&](const size_t lane) { pc = pcs[lane] < pc ? pcs[lane] : pc; });
+
+            mask = 0;
+            for_lanes(active, [&](const size_t lane) { mask |= LaneMask(pcs[lane] == pc) << lane; });
+
+            split = mask != active;
+        }
+
+        const DecodedOp& op = ops[pc];
+        const size_t count = std::popcount(mask);
+
+        stats.lane_steps_ += count;
+        stats.lockstep_steps_ += mask == active ? count : 0;
+
+        const uint16_t imm = op.imm_;
+        const uint32_t length = op.length_;
+        const uint32_t target = imm < end ? imm : end;
+
+        uint16_t* const from = regs[op.src_];
+        uint16_t* const to = regs[op.dest_];
+        uint16_t* const cbus = regs[R_CBUS_CACHE];
+        uint16_t* const mar = regs[R_MAR];
+        const uint16_t* const lgc = regs[R_LGC];
+
+        uint16_t value[BATCH_LANES];
+        bool branch = false;
+
+        switch (op.handler_) {
+            case(OP_NOP):
+                advance(mask, 1);
+                break;
+            case(OP_MOV_R):
+                for_lanes(mask, [&](const size_t lane) { value[lane] = from[lane]; });
+                for_lanes(mask, [&](const size_t lane) { to[lane] = value[lane]; });
+                advance(mask, 1);
+                break;
+            case(OP_MOV_I):
+                for_lanes(mask, [&](const size_t lane) { cbus[lane] = imm; });
+                for_lanes(mask, [&](const size_t lane) { to[lane] = imm; });
+                advance(mask, 2);
+                break;
+            case(OP_MOV_M):
+                for_lanes(mask, [&](const size_t lane) { value[lane] = ram[mar[lane] * BATCH_LANES + lane]; });
+                for_lanes(mask, [&](const size_t lane) { to[lane] = value[lane]; });
+                advance(mask, 1);
+                break;
+            case(OP_ADD_R):
+            case(OP_SUB_R):
+            case(OP_CMP_R):
+            case(OP_ADD_I):
+            case(OP_SUB_I):
+            case(OP_CMP_I):
+                if (length == 2) {
+                    for_lanes(mask, [&](const size_t lane) { cbus[lane] = imm; });
+                    for_lanes(mask, [&](const size_t lane) { value[lane] = imm; });
+                } else {
+                    for_lanes(mask, [&](const size_t lane) { value[lane] = from[lane]; });
+                }
+
+                alu_lanes(mask, op.handler_ == OP_ADD_R || op.handler_ == OP_ADD_I, value);
+
+                advance(mask, length);
+                break;
+            case(OP_JMP_R):
+                for_lanes(mask, [&](const size_t lane) { pcs[lane] = from[lane] < end ? from[lane] : end; });
+                for_lanes(mask, [&](const size_t lane) { cycles[lane] += 1; });
+                branch = true;
+                break;
+            case(OP_JMP_I):
+                for_lanes(mask, [&](const size_t lane) { cbus[lane] = imm; });
+                for_lanes(mask, [&](const size_t lane) { pcs[lane] = target; });
+                for_lanes(mask, [&](const size_t lane) { cycles[lane] += 2; });
+                break;
+            case(OP_JE_R):
+            case(OP_JNE_R): {
+                const uint16_t equal = op.handler_ == OP_JE_R ? LGC_EQUAL : 0;
+
+                for_lanes(mask, [&](const size_t lane) {
+                    const uint32_t to_pc = from[lane] < end ? from[lane] : end;
+
+                    pcs[lane] = (lgc[lane] & LGC_EQUAL) == equal ? to_pc : pc + 1;
+                });
+                for_lanes(mask, [&](const size_t lane) { cycles[lane] += 1; });
+                branch = true;
+                break;
+            }
+            case(OP_JE_I):
+            case(OP_JNE_I): {
+                const uint16_t equal = op.handler_ == OP_JE_I ? LGC_EQUAL : 0;
+
+                for_lanes(mask, [&](const size_t lane) { pcs[lane] = (lgc[lane] & LGC_EQUAL) == equal ? target : pc + 2; });
+                for_lanes(mask, [&](const size_t lane) { cycles[lane] += 2; });
+                for_lanes(mask, [&](const size_t lane) { cbus[lane] = imm; });
+                branch = true;
+                break;
+            }
+            case(OP_WR_R):
+                for_lanes(mask, [&](const size_t lane) { ram[mar[lane] * BATCH_LANES + lane] = from[lane]; });
+                advance(mask, 1);
+                break;
+            case(OP_EXEC):
+                // the word at mar is fetched from each lane's own ram, so every lane decodes it alone
+                for_lanes(mask, [&](const size_t lane) {
+                    const uint16_t address = mar[lane];
+                    const Word word = ram[address * BATCH_LANES + lane];
+                    const Word next = ram[static_cast<uint16_t>(address + 1) * BATCH_LANES + lane];
+                    uint32_t next_pc = pc + 1;
+
+                    cycles[lane] += word_flags(word) == FLAG_IMM ? 3 : 2;
+
+                    if (word == make_word(ALU_NONE, BUS_RAM, BUS_RAM, FLAG_NONE)) {
+                        group.bad_word_[lane] = word;
+                        stop(lane, invalid_word);
+                        return;
+                    }
+
+                    const HaltReasons reason = execute(lane, word, next, next_pc);
+
+                    if (reason != invalid_word) {
+                        pcs[lane] = next_pc < end ? next_pc : end;
+                    }
+
+                    if (reason == halted) {
+                        stop(lane, halted);
+                    }
+                });
+                branch = true;
+                break;
+            case(OP_HLT):
+                advance(mask, 1);
+                for_lanes(mask, [&](const size_t lane) { stop(lane, halted); });
+                break;
+            case(OP_GENERIC):
+                for_lanes(mask, [&](const size_t lane) {
+                    uint32_t next_pc = pc + length;
+                    const HaltReasons reason = execute(lane, op.word_, imm, next_pc);
+
+                    if (reason == invalid_word) {
+                        return;
+                    }
+
+                    cycles[lane] += length;
+                    pcs[lane] = next_pc < end ? next_pc : end;
+
+                    if (reason == halted) {
+                        stop(lane, halted);
+                    }
+                });
+                branch = true;
+                break;
+            default:
+                for_lanes(mask, [&](const size_t lane) {
+                    pcs[lane] = end;
+                    stop(lane, end_of_rom);
+                });
+                break;
+        }
+
+        if (!branch) {
+            continue;
+        }
+
+        // lanes that took different ways out of this branch, counted at the branch
+        const LaneMask moved = mask & active;
+
+        if (moved == 0) {
+            continue;
+        }
+
+        const uint32_t first = pcs[std::countr_zero(moved)];
+        uint32_t differ = 0;
+
+        for_lanes(moved, [&](const size_t lane) { differ |= pcs[lane] ^ first; });
+
+        if (differ != 0) {
+            ++stats.splits_[pc];
+            split = true;
+        }
+    }
+}
+
+/*
+ * fnv-1a over the address and value of every non zero word, for all lanes at once. Most of ram
+ * stays zero, so a row with nothing set in any lane is skipped after one pass over it.
+ */
+static void ram_hashes(const uint16_t* ram, uint64_t (&hashes)[BATCH_LANES]) {
+    for (size_t lane = 0; lane < BATCH_LANES; ++lane) {
+        hashes[lane] = 0xCBF29CE484222325ull;
+    }
+
+    for (size_t address = 0; address < RAM_WORDS; ++address) {
+        const uint16_t* row = ram + address * BATCH_LANES;
+        uint16_t any = 0;
+
+        for (size_t lane = 0; lane < BATCH_LANES; ++lane) {
+            any |= row[lane];
+        }
+
+        if (any == 0) {
+            continue;
+        }
+
+        for (size_t lane = 0; lane < BATCH_LANES; ++lane) {
+            if (row[lane] != 0) {
+                hashes[lane] = (hashes[lane] ^ address) * 0x100000001B3ull;
+                hashes[lane] = (hashes[lane] ^ row[lane]) * 0x100000001B3ull;
+            }
+        }
+    }
+}
+
+static std::string mismatch(const char* name, const uint32_t value, const uint16_t expected) {
+    std::ostringstream text;
+
+    text << name << "=0x" << std::hex << std::uppercase << std::setfill('0')
+         << std::setw(4) << value << " (expected 0x" << std::setw(4) << expected << ")";
+
+    return text.str();
+}
+
+static void collect_results(const LaneGroup& group, const std::vector<TestVector>& vectors, const size_t first, const size_t count, std::vector<InstanceResult>& results) {
+    const uint16_t* ram = group.ram_.data();
+
+    uint64_t hashes[BATCH_LANES];
+    ram_hashes(ram, hashes);
+
+    for (size_t lane = 0; lane < count; ++lane) {
+        const TestVector& vector = vectors[first + lane];
+        InstanceResult& result = results[first + lane];
+
+        for (size_t reg = 0; reg < R_COUNT; ++reg) {
+            result.regs_[reg] = group.regs_[reg][lane];
+        }
+
+        result.pc_ = group.pc_[lane];
+        result.cycles_ = group.cycles_[lane];
+        result.reason_ = group.reason_[lane];
+        result.bad_word_ = group.bad_word_[lane];
+        result.ram_hash_ = hashes[lane];
+
+        for (const auto& [reg, expected] : vector.expected_registers_) {
+            const uint32_t value = reg == VECTOR_PC ? result.pc_ : result.regs_[reg];
+
+            if (value != expected) {
+                result.mismatches_.push_back(mismatch(vector_register_names[reg], value, expected));
+            }
+        }
+
+        for (const auto& [address, expected] : vector.expected_ram_) {
+            const uint16_t value = ram[address * BATCH_LANES + lane];
+
+            if (value != expected) {
+                std::ostringstream name;
+                name << "@0x" << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << address;
+
+                result.mismatches_.push_back(mismatch(name.str().c_str(), value, expected));
+            }
+        }
+    }
+}
+
+BatchReport BatchEmulator::run(const std::vector<TestVector>& vectors, const uint64_t max_cycles, const size_t threads) const {
+    BatchReport report;
+    report.instances_.resize(vectors.size());
+
+    const std::vector<DecodedOp>& decoded = program_.decoded();
+    const uint32_t end = static_cast<uint32_t>(program_.rom().size());
+
+    std::mutex mutex;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    {
+        ThreadPool pool { threads };
+        report.threads_ = pool.size();
+
+        for (size_t first = 0; first < vectors.size(); first += BATCH_LANES) {
+            pool.submit([&, first] {
+                const size_t count = std::min(BATCH_LANES, vectors.size() - first);
+                const LaneMask lanes = count == BATCH_LANES ? ALL_LANES : (LaneMask(1) << count) - 1;
+
+                // 8 MiB of ram per group, kept by each worker for its next group instead of being faulted in again
+                thread_local std::unique_ptr<LaneGroup> group;
+
+                if (group == nullptr) {
+                    group = std::make_unique<LaneGroup>();
+                } else {
+                    group->clear();
+                }
+
+                for (size_t lane = 0; lane < count; ++lane) {
+                    const TestVector& vector = vectors[first + lane];
+
+                    for (const auto& [reg, value] : vector.registers_) {
+                        group->regs_[reg][lane] = value;
+                    }
+
+                    for (const auto& [address, value] : vector.ram_) {
+                        group->ram_[address * BATCH_LANES + lane] = value;
+                    }
+
+                }
+
+                GroupStats stats;
+                run_group(*group, lanes, decoded, end, max_cycles, stats);
+                collect_results(*group, vectors, first, count, report.instances_);
+
+                std::lock_guard<std::mutex> lock { mutex };
+
+                report.lane_steps_ += stats.lane_steps_;
+                report.lockstep_steps_ += stats.lockstep_steps_;
+
+                for (const auto& [pc, splits] : stats.splits_) {
+                    report.splits_[pc] += splits;
+                }
+            });
+        }
+
+        pool.wait();
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    report.seconds_ = elapsed.count();
+
+    return report;
+}
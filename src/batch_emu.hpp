@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "emulator.hpp"
+
+// instances run together in one group, one bit of a lane mask each
+constexpr size_t BATCH_LANES = 64;
+
+// register file index used for pc in the values of a test vector
+constexpr uint8_t VECTOR_PC = R_COUNT;
+
+// one instance of a batch run: what it starts with and, optionally, what it has to stop with
+struct TestVector {
+    uint32_t line_ = 0;
+
+    // EmuRegisters index (or VECTOR_PC for expected values) and value
+    std::vector<std::pair<uint8_t, uint16_t>> registers_;
+    std::vector<std::pair<uint16_t, uint16_t>> ram_;
+
+    std::vector<std::pair<uint8_t, uint16_t>> expected_registers_;
+    std::vector<std::pair<uint16_t, uint16_t>> expected_ram_;
+};
+
+/*
+ * Vector files hold one instance per line: register and ram values, then optionally => and the
+ * values it must stop with. # starts a comment and blank lines are skipped.
+ *   a=0x1 b=0x20 @0x10=0x5,0x6 => acc=0x21 pc=0x12 @0x30=0x1
+ */
+bool read_vectors(const std::string& file_name, std::vector<TestVector>& vectors, std::string& error);
+
+// state one instance stopped in
+struct InstanceResult {
+    std::array<uint16_t, R_COUNT> regs_ {};
+    uint32_t pc_ = 0;
+    uint64_t cycles_ = 0;
+    HaltReasons reason_ = running;
+    Word bad_word_ = 0;
+
+    // fnv-1a of the address and value of every non zero ram word, equal rams give equal hashes
+    uint64_t ram_hash_ = 0;
+
+    // expected values it did not stop with, "a=0x0003 (expected 0x0005)"
+    std::vector<std::string> mismatches_;
+};
+
+struct BatchReport {
+    std::vector<InstanceResult> instances_;
+
+    // instructions run summed over the instances, and how many of them ran with every running lane of their group
+    uint64_t lane_steps_ = 0;
+    uint64_t lockstep_steps_ = 0;
+
+    // rom address of a branch that split a group and the number of times it did
+    std::map<uint32_t, uint64_t> splits_;
+
+    size_t threads_ = 0;
+    double seconds_ = 0;
+};
+
+/*
+ * Runs the program of an emulator from many starting states at once. Instances are dealt out in
+ * groups of BATCH_LANES to a thread pool, and a group keeps registers, pc, cycles and ram as
+ * structure of arrays, lane i of each array being instance i. All lanes at the same pc run each
+ * instruction together in one loop over the lanes, which the compiler can vectorize. When a
+ * branch sends lanes different ways the lanes with the lowest pc run first, so they meet again
+ * where the paths join. Results are the same as running each instance on its own.
+ */
+class BatchEmulator {
+    private:
+        const Emulator& program_;
+
+    public:
+        BatchEmulator() = delete;
+
+        // program has to stay loaded while the batch runs
+        explicit BatchEmulator(const Emulator& program) : program_(program) {};
+
+        // threads 0 uses every core
+        BatchReport run(const std::vector<TestVector>& vectors, uint64_t max_cycles, size_t threads) const;
+
+        ~BatchEmulator() = default;
+};
@@ -0,0 +1,297 @@
+#include "cache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+static constexpr uint64_t HASH_SEED_HIGH = 0x9E3779B97F4A7C15;
+static constexpr uint64_t HASH_SEED_LOW = 0xC2B2AE3D27D4EB4F;
+
+// 64 bit finalizer from murmur3
+static uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCD;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53;
+    value ^= value >> 33;
+
+    return value;
+}
+
+// hashes eight bytes at a time, the tail is zero padded and the length is mixed in
+static uint64_t hash_bytes(std::string_view data, uint64_t seed) {
+    uint64_t hash = seed ^ mix(data.size() + seed);
+    size_t i = 0;
+
+    for (; i + 8 <= data.size(); i += 8) {
+        uint64_t block;
+        memcpy(&block, data.data() + i, 8);
+
+        hash ^= mix(block ^ seed);
+        hash = ((hash << 27) | (hash >> 37)) * 0x100000001B3 + 0x52DCE729;
+    }
+
+    if (i < data.size()) {
+        uint64_t block = 0;
+        memcpy(&block, data.data() + i, data.size() - i);
+
+        hash ^= mix(block ^ seed);
+    }
+
+    return mix(hash);
+}
+
+std::string CacheKey::hex() const {
+    static const char digits[] = "0123456789abcdef";
+    std::string text(32, '0');
+
+    for (int i = 0; i < 16; ++i) {
+        text[15 - i] = digits[(high_ >> (i * 4)) & 0xF];
+        text[31 - i] = digits[(low_ >> (i * 4)) & 0xF];
+    }
+
+    return text;
+}
+
+CacheKey CompileCache::make_key(std::string_view source, OutputTypes type, OutputFormats format, bool optimize, bool object, const std::string& map_source) {
+    std::string header { SPLC_VERSION };
+    header += '\0';
+    header += static_cast<char>('0' + type);
+    header += static_cast<char>('0' + format);
+    header += optimize ? 'O' : '-';
+    header += object ? 'c' : '-';
+    header += map_source.empty() ? '-' : 'g';
+    header += map_source;
+    header += '\0';
+
+    return {
+        hash_bytes(source, hash_bytes(header, HASH_SEED_HIGH)),
+        hash_bytes(source, hash_bytes(header, HASH_SEED_LOW)),
+    };
+}
+
+std::string CompileCache::entry_path(const CacheKey& key) const {
+    return directory_ + "/" + key.hex();
+}
+
+bool CompileCache::open(std::string& error) {
+    std::error_code code;
+    std::filesystem::create_directories(directory_, code);
+
+    if (code || !std::filesystem::is_directory(directory_)) {
+        error = "Failed to open cache directory: " + directory_;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * entries are text headers each followed by raw contents:
+ *   spl-cache v1
+ *   words <count>\n<count words in host byte order>
+ *   image <name> <bytes>\n<contents>
+ */
+bool CompileCache::load(const CacheKey& key, CacheEntry& entry) {
+    std::ifstream file { entry_path(key), std::ios::binary };
+
+    auto miss = [&] {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    };
+
+    if (!file.is_open()) {
+        return miss();
+    }
+
+    file.seekg(0, std::ios::end);
+    const std::streamoff file_size = file.tellg();
+    file.seekg(0);
+
+    // a damaged header must not make us allocate more than the file could hold
+    auto bytes_left = [&] {
+        return static_cast<size_t>(file_size - file.tellg());
+    };
+
+    std::string line;
+
+    if (!std::getline(file, line) || line != "spl-cache v1") {
+        return miss();
+    }
+
+    entry = CacheEntry();
+
+    while (std::getline(file, line)) {
+        std::istringstream fields { line };
+        std::string kind;
+        std::string name;
+        size_t size = 0;
+
+        fields >> kind;
+
+        if (kind == "words" && fields >> size) {
+            if (size > bytes_left() / sizeof(Word)) {
+                return miss();
+            }
+
+            entry.words_.resize(size);
+
+            if (!file.read(reinterpret_cast<char*>(entry.words_.data()), size * sizeof(Word))) {
+                return miss();
+            }
+
+            continue;
+        }
+
+        if (kind != "image" || !(fields >> name >> size) || size > bytes_left()) {
+            return miss();
+        }
+
+        std::string contents(size, '\0');
+
+        if (!file.read(contents.data(), size)) {
+            return miss();
+        }
+
+        entry.images_.emplace_back(name, std::move(contents));
+    }
+
+    if (entry.images_.empty()) {
+        return miss();
+    }
+
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool CompileCache::store(const CacheKey& key, const CacheEntry& entry) {
+    const std::string path = entry_path(key);
+
+    // unique per process and per store, so concurrent writers never share a temporary file
+    const std::string temp = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(temp_files_.fetch_add(1));
+
+    {
+        std::ofstream file { temp, std::ios::binary };
+
+        if (!file.is_open()) {
+            return false;
+        }
+
+        file << "spl-cache v1\n";
+        file << "words " << entry.words_.size() << '\n';
+        file.write(reinterpret_cast<const char*>(entry.words_.data()), entry.words_.size() * sizeof(Word));
+
+        for (const auto& [name, contents] : entry.images_) {
+            file << "image " << name << ' ' << contents.size() << '\n' << contents;
+        }
+
+        file.close();
+
+        if (file.fail()) {
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+
+    std::error_code code;
+    std::filesystem::rename(temp, path, code);
+
+    if (code) {
+        std::remove(temp.c_str());
+        return false;
+    }
+
+    stores_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+CacheStats CompileCache::stats() const {
+    return { hits_.load(), misses_.load(), stores_.load() };
+}
+
+static bool parse_totals(const std::string& text, CacheStats& totals) {
+    std::istringstream fields { text };
+    std::string name;
+    uint64_t value;
+
+    while (fields >> name >> value) {
+        if (name == "hits") {
+            totals.hits_ = value;
+        } else if (name == "misses") {
+            totals.misses_ = value;
+        } else if (name == "stores") {
+            totals.stores_ = value;
+        }
+    }
+
+    return true;
+}
+
+static std::string read_fd(int fd) {
+    std::string text;
+    char chunk[256];
+    ssize_t count;
+
+    lseek(fd, 0, SEEK_SET);
+
+    while ((count = read(fd, chunk, sizeof(chunk))) > 0) {
+        text.append(chunk, count);
+    }
+
+    return text;
+}
+
+bool CompileCache::record_totals() const {
+    const int fd = ::open((directory_ + "/stats").c_str(), O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    // the lock covers the read, update and write of the whole file
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return false;
+    }
+
+    CacheStats totals;
+    parse_totals(read_fd(fd), totals);
+
+    const CacheStats current = stats();
+    totals.hits_ += current.hits_;
+    totals.misses_ += current.misses_;
+    totals.stores_ += current.stores_;
+
+    const std::string text = "hits " + std::to_string(totals.hits_) + "\nmisses " + std::to_string(totals.misses_)
+        + "\nstores " + std::to_string(totals.stores_) + "\n";
+
+    const bool ok = ftruncate(fd, 0) == 0 && pwrite(fd, text.data(), text.size(), 0) == static_cast<ssize_t>(text.size());
+
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    return ok;
+}
+
+bool CompileCache::read_totals(CacheStats& totals) const {
+    const int fd = ::open((directory_ + "/stats").c_str(), O_RDONLY);
+
+    totals = CacheStats();
+
+    if (fd < 0) {
+        return true;
+    }
+
+    flock(fd, LOCK_SH);
+    parse_totals(read_fd(fd), totals);
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "isa.hpp"
+#include "output.hpp"
+
+// part of every cache key, bump it whenever the compiler output changes so old entries are never reused
+constexpr std::string_view SPLC_VERSION = "splc 1.1";
+
+struct CacheKey {
+    uint64_t high_ = 0;
+    uint64_t low_ = 0;
+
+    // 32 hex digits, used as the entry file name
+    std::string hex() const;
+};
+
+// everything a compile produces, replayed on a hit
+struct CacheEntry {
+    std::vector<Word> words_;
+
+    // named like the images write_images produces, plus "out.map" when a line map was written
+    std::vector<std::pair<std::string, std::string>> images_;
+};
+
+struct CacheStats {
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t stores_ = 0;
+};
+
+/*
+ * On-disk cache of compiled images keyed by a 128 bit hash of the source bytes, the output type,
+ * the compiler version and the options. Entries are written to a temporary file and renamed into
+ * place, so concurrent compiles sharing a directory only ever see whole entries; two processes
+ * storing the same key both write the same bytes and the last rename wins.
+ */
+class CompileCache {
+    private:
+        std::string directory_;
+
+        std::atomic<uint64_t> hits_ { 0 };
+        std::atomic<uint64_t> misses_ { 0 };
+        std::atomic<uint64_t> stores_ { 0 };
+        std::atomic<uint64_t> temp_files_ { 0 };
+
+        std::string entry_path(const CacheKey& key) const;
+
+    public:
+        explicit CompileCache(const std::string& directory) : directory_(directory) {};
+
+        CompileCache(const CompileCache&) = delete;
+        CompileCache& operator=(const CompileCache&) = delete;
+
+        // creates the directory when it is missing
+        bool open(std::string& error);
+
+        // map_source is the path recorded in the line map, empty when no map is written
+        static CacheKey make_key(std::string_view source, OutputTypes type, OutputFormats format, bool optimize, bool object, const std::string& map_source);
+
+        // false on a miss, a damaged entry counts as a miss
+        bool load(const CacheKey& key, CacheEntry& entry);
+        bool store(const CacheKey& key, const CacheEntry& entry);
+
+        // lookups made through this object
+        CacheStats stats() const;
+
+        // adds stats() to the totals kept in the directory, safe against other processes doing the same
+        bool record_totals() const;
+        bool read_totals(CacheStats& totals) const;
+
+        ~CompileCache() = default;
+};
@@ -1,5 +1,7 @@
 #include "compiler.hpp"
 
+#include <sstream>
+
 bool SCompiler::set_output(const std::string& format) {
     if (format == "D8") {
         output_type_ = HALF_DUAL_WORD;
@@ -15,337 +17,552 @@ bool SCompiler::set_output(const std::string& format) {
     return false;
 }
 
-void SCompiler::split(std::string str, const std::string& delim, std::vector<std::string>& out) {
-    const size_t delim_len = delim.length();
-    size_t pos = 0;
-
-    while ((pos = str.find(delim)) != std::string::npos) {
-        out.push_back(str.substr(0, pos));
-        str.erase(0, pos + delim_len);
+Errors SCompiler::load_file(const std::string& file_name) {
+    if (!source_.open(file_name)) {
+        error(0, "File not found: " + file_name);
+        return file_not_found;
     }
 
-    if (str.size() > 0) {
-        out.push_back(str);
-    }
+    return OK;
 }
 
-Errors SCompiler::load_file(const std::string& file_name) {
-    std::ifstream file { file_name };
+bool SCompiler::is_valid_reg(const std::string_view reg) {
+    return find_register(reg) >= 0;
+}
 
-    if (!file.is_open()) {
-        std::cout << "File not found: " << file_name << '\n';
-        return file_not_found;
+bool SCompiler::is_valid_imm(const std::string_view imm, uint16_t& value, const uint32_t line) {
+    if (imm.size() < 3 || imm[0] != '0' || imm[1] != 'x') {
+        error(line, "Immediate value must be in hex format (starting with 0x)");
+        return false;
     }
 
-    std::string line;
-
-    // remove blank lines
-    while (std::getline(file, line)) {
-        if (line.length() > 0 && line[0] != '\r') {
-            if (!line.empty() && line[line.size() - 1] == '\r') {
-                line.erase(line.size() - 1);
-            }
+    uint32_t parsed = 0;
 
-            lines_.push_back(line);
+    for (const char digit : imm.substr(2)) {
+        if (!isxdigit(digit)) {
+            return false;
         }
-    }
 
-    file.close();
-
-    return OK;
-}
+        parsed = parsed * 16 + (isdigit(digit) ? digit - '0' : (tolower(digit) - 'a' + 10));
 
-Errors SCompiler::locate_instruction(const std::string& inst_name) {
-    for (const auto& [name, _] : instructions_) {
-        if (name == inst_name) {
-            return OK;
+        if (parsed > 0xFFFF) {
+            error(line, "Immediate value out of range: " + std::string(imm) + " for uint16");
+            return false;
         }
     }
 
-    return invalid_instruction;
+    value = static_cast<uint16_t>(parsed);
+    return true;
 }
 
-bool SCompiler::is_valid_reg(const std::string& reg) {
-    for (const auto& [name, _] : registers_) {
-        if (name == reg) {
-            return true;
+bool SCompiler::is_valid_label(const std::string_view label) {
+    if (label.empty() || !(isalpha(label[0]) || label[0] == '_' || label[0] == '.')) {
+        return false;
+    }
+
+    for (const char& c : label) {
+        if (!(isalnum(c) || c == '_' || c == '.')) {
+            return false;
         }
     }
 
-    return false;
+    return true;
 }
 
-bool SCompiler::is_valid_imm(const std::string& imm) {
-    if (imm[0] != '0' || imm[1] != 'x') {
-        std::cout << "Immediate value must be in hex format (starting with 0x)" << '\n';
-        return false;
-    }
+bool SCompiler::parse_operand(const InstructionInfo& inst, const std::string_view arg, const size_t token, const uint8_t token_num) {
+    const Types expected = inst.child_types_[token_num];
+    const uint32_t line = tokens_.lines_[token];
 
-    for (const char& digit : imm.substr(2)) {
-        if (!isxdigit(digit)) {
+    uint8_t& kind = tokens_.kinds_[token_num][token];
+    uint16_t& value = tokens_.values_[token_num][token];
+
+    const int reg = find_register(arg);
+
+    if (reg >= 0 && expected != IMM) {
+        // mov and rd write their register operand, which must be writable from the bus
+        if (expected == REG && (inst.type_ == MOV || inst.type_ == RD) && register_codes[reg].from_bus_ == N_ALWD) {
+            error(line, "Register is read only: " + std::string(arg) + ", for instruction " + std::string(inst.name_) + " on line " + std::to_string(line));
             return false;
         }
-    }
 
-    if (std::stoi(imm, 0, 16) > 0xFFFF){
-        std::cout << "Immediate value out of range: " << imm << " for uint16" << '\n';
+        kind = REG;
+        value = static_cast<uint16_t>(reg);
+        return true;
+    }
 
+    if (expected == REG) {
+        error(line, "Invalid register: " + std::string(arg) + ", for instruction " + std::string(inst.name_) + " on line " + std::to_string(line));
         return false;
     }
 
-    return true;
-}
+    // anything that is not a register but looks like a name is a constant or a label
+    if (is_valid_label(arg)) {
+        const auto constant = equs_.find(arg);
+        kind = IMM;
 
-TKCptr SCompiler::make_token(Instruction inst, const std::string& arg, const std::string& inst_name, const int token_num) {
-    if (inst.child_types_.at(token_num) == REG) {
-        if (is_valid_reg(arg)) {
-            return std::make_shared<Register>(REG, arg);
+        if (constant != equs_.end()) {
+            value = constant->second;
         } else {
-            std::cout << "Invalid register: " << arg << ", for instruction " << inst_name << '\n';
-            return nullptr;
-        }
-    } else if (inst.child_types_.at(token_num) == IMM) {
-        if (is_valid_imm(arg)) {
-            return std::make_shared<Immediate>(IMM, arg);
-        } else {
-            std::cout << "Invalid immidate: " << arg << ", for instruction " << inst_name << '\n';
-            return nullptr;
+            label_uses_.push_back({ arg, static_cast<uint32_t>(token), token_num });
         }
+
+        return true;
+    }
+
+    if (is_valid_imm(arg, value, line)) {
+        kind = IMM;
+        return true;
+    }
+
+    if (expected == IMM) {
+        error(line, "Invalid immidate: " + std::string(arg) + ", for instruction " + std::string(inst.name_) + " on line " + std::to_string(line));
     } else {
-        bool valid_reg = is_valid_reg(arg);
-        bool valid_imm = false;
+        error(line, "Invalid register/immidate: " + std::string(arg) + ", for instruction " + std::string(inst.name_) + " on line " + std::to_string(line));
+    }
 
-        if (!valid_reg) {
-            valid_imm = is_valid_imm(arg);
-        }
+    return false;
+}
 
-        if ((valid_imm || valid_reg) && inst.child_types_.at(token_num) == REG_IMM) {
-            if (valid_reg) {
-                return std::make_shared<Register>(REG, arg);
-            } else {
-                return std::make_shared<Immediate>(IMM, arg);
-            }
-        } else {
-            std::cout << "Invalid register/immidate: " << arg << ", for instruction " << inst_name << '\n';
-            return nullptr;
+Errors SCompiler::parse_file() {
+    Lexer lexer { source_.text() };
+    LineReader reader { lexer };
+    LexToken line;
+
+    // at most one instruction per line, so the token arrays are allocated once unless macros add more
+    tokens_.reserve(arena_, source_.line_count());
+
+    while (reader.next(line)) {
+        const Errors result = parse_line(line, reader, nullptr, 0);
+
+        if (result != OK) {
+            return result;
         }
     }
-}
 
-std::string SCompiler::htos(const std::string& hex_value) {
-    return std::bitset<16>(std::stoi(hex_value, 0, 16)).to_string();
+    return OK;
 }
 
-InstPtr SCompiler::get_instruction_struct(const Instructions& inst) {
-    switch (inst) {
-        case(MOV):
-            return std::make_shared<MOV_Inst>();
-        case(HLT):
-            return std::make_shared<HLT_Inst>();
-        case(WR):
-            return std::make_shared<WR_Inst>();
-        case(RD):
-            return std::make_shared<RD_Inst>();
-        case(ADD):
-            return std::make_shared<ADD_Inst>();
-        case(SUB):
-            return std::make_shared<SUB_Inst>();
-        case(CMP):
-            return std::make_shared<COMP_Inst>();
-        case(JE):
-            return std::make_shared<JE_Inst>();
-        case(JNE):
-            return std::make_shared<JNE_Inst>();
-        case(JMP):
-            return std::make_shared<JMP_Inst>();
-        case(EXEC):
-            return std::make_shared<EXEC_Inst>();
-        default:
-            return nullptr;
-    };
+bool SCompiler::check_label(const LexToken& line) {
+    if (!is_valid_label(line.label_) || is_valid_reg(line.label_)) {
+        error(line.line_, "Invalid label: " + std::string(line.label_) + " on line " + std::to_string(line.line_));
+        return false;
+    }
+
+    return true;
 }
 
-Errors SCompiler::parse_file() {
-    for (const std::string& line : lines_) {
-        std::vector<std::string> line_tokens;
-        std::vector<std::string> first_part;
+Errors SCompiler::parse_instruction(const LexToken& line) {
+    const InstructionInfo* info = find_instruction(line.mnemonic_);
 
-        split(line, ",", line_tokens);
+    if (info == nullptr) {
+        error(line.line_, "Invalid instruction: " + std::string(line.mnemonic_) + " on line " + std::to_string(line.line_));
+        return invalid_instruction;
+    }
+
+    const InstructionInfo& inst = *info;
+    const size_t children = static_cast<size_t>(inst.children_);
 
-        split(line_tokens.at(0), " ", first_part);
+    if (children != line.operand_count_ && !(children == 0 && line.operand_count_ == 1)) {
+        error(line.line_, "Invalid number of arguments for instruction: " + std::string(inst.name_) + " on line " + std::to_string(line.line_));
+        return invalid_instruction;
+    }
 
-        std::string inst_name = first_part.at(0);
+    const size_t token = tokens_.push(arena_, inst.type_, line.line_);
 
-        if (first_part.size() > 1) {
-            line_tokens.at(0) = first_part.at(1);
+    for (int token_num = 0; token_num < inst.children_; ++token_num) {
+        if (!parse_operand(inst, line.operands_[token_num], token, static_cast<uint8_t>(token_num))) {
+            return invalid_instruction;
         }
+    }
 
-        if (!inst_name.empty()) {
-            std::string name;
+    return OK;
+}
 
-            if (locate_instruction(inst_name) != OK) {
-                std::cout << "Invalid instruction: " << inst_name << '\n';
-                return invalid_instruction;
-            }
+Errors SCompiler::resolve_labels() {
+    // every encoding has a fixed size, so one pass gives the exact address of each instruction and copy
+    std::vector<uint32_t> addresses;
+    addresses.reserve(next_item() + 1);
 
-            Instruction inst = instructions_.at(inst_name);
+    uint64_t address = 0;
+    size_t copy = 0;
 
-            if (inst.children_ != line_tokens.size() && !(inst.children_ == 0 && line_tokens.size() == 1)) {
-                std::cout << "Invalid number of arguments for instruction: " << inst_name << '\n';
+    for (size_t token = 0; token <= tokens_.size(); ++token) {
+        // copies in front of the token, each one after the items it repeats
+        for (; copy < copies_.size() && copies_[copy].position_ == token; ++copy) {
+            WordCopy& words = copies_[copy];
+
+            addresses.push_back(static_cast<uint32_t>(address));
+            words.from_ = addresses[words.first_];
+            words.size_ = addresses[words.end_] - words.from_;
+            address += static_cast<uint64_t>(words.size_) * words.count_;
+
+            if (address > MAX_EXPANDED_WORDS) {
+                error(words.line_, "Expansion too large: " + std::to_string(address) + " words on line " + std::to_string(words.line_));
                 return invalid_instruction;
             }
+        }
 
-            TKptr inst_token = std::make_shared<Token>(inst.type_, std::vector<TKCptr>());
+        if (token == tokens_.size()) {
+            break;
+        }
 
-            if (inst.children_ == 0) {
-                tokens_.push_back(inst_token);
-                continue;
-            }
+        addresses.push_back(static_cast<uint32_t>(address));
+        address += instruction_size(tokens_.opcode(token), tokens_.kind(token, 0), tokens_.kind(token, 1));
+    }
 
-            int token_num = 0;
+    // a label after the last instruction points just past the end of the program
+    addresses.push_back(static_cast<uint32_t>(address));
 
-            for (std::string& arg : line_tokens) {
+    for (const LabelUse& use : label_uses_) {
+        const auto label = labels_.find(use.name_);
 
-                arg.erase(std::remove(arg.begin(), arg.end(), ' '), arg.end());
+        const uint32_t line = tokens_.lines_[use.token_];
 
-                TKCptr token = make_token(inst, arg, inst_name, token_num);
+        // a constant defined after its use
+        if (label == labels_.end() && equs_.count(use.name_) > 0) {
+            tokens_.values_[use.operand_][use.token_] = equs_.at(use.name_);
+            continue;
+        }
 
-                if (token == nullptr) {
-                    return invalid_instruction;
-                }
+        // filled in by the linker, the relocation is recorded when the word is encoded
+        if (label == labels_.end() && write_object_ && imports_.count(use.name_) > 0) {
+            continue;
+        }
 
-                inst_token->children_.push_back(token);
+        if (label == labels_.end()) {
+            error(line, "Undefined label: " + std::string(use.name_) + " on line " + std::to_string(line));
+            return invalid_label;
+        }
 
-                ++token_num;
-            }
+        const uint32_t target = addresses[label->second];
 
-            tokens_.push_back(inst_token);
+        if (target > 0xFFFF) {
+            error(line, "Label out of range: " + std::string(use.name_) + " on line " + std::to_string(line));
+            return invalid_label;
         }
+
+        tokens_.values_[use.operand_][use.token_] = static_cast<uint16_t>(target);
+    }
+
+    if (!write_object_) {
+        return OK;
+    }
+
+    for (const auto& [name, line] : globals_) {
+        const auto label = labels_.find(name);
+
+        if (label == labels_.end()) {
+            error(line, "Undefined label: " + std::string(name) + " on line " + std::to_string(line));
+            return invalid_label;
+        }
+
+        object_.exports_.push_back({ std::string(name), addresses[label->second] });
     }
 
     return OK;
 }
 
 Errors SCompiler::parse_tree() {
-    for (const auto& tree_parent : tokens_) {
-        int child_num = 0;
-        InstPtr inst = get_instruction_struct(tree_parent->type_);
-
-        Types first;
-        Types second;
-
-        std::string first_value;
-        std::string second_value;
-
-        for (const auto& tree_child: tree_parent->children_) {
-            if (tree_child->type_ == REG) {
-                if (child_num == 0) {
-                    first = REG;
-                    first_value = tree_child->name_;
-                } else {
-                    second = REG;
-                    second_value = tree_child->name_;
-                }
-            } else if (tree_child->type_ == IMM) {
-                if (child_num == 0) {
-                    first = IMM;
-                    first_value = tree_child->value_;
-                } else {
-                    second = IMM;
-                    second_value = tree_child->value_;
-                }
-            }
+    output_.reserve(tokens_.size() * 2);
+    line_map_.entries_.reserve(tokens_.size());
+
+    size_t copy = 0;
+    size_t use = 0;
 
-            ++child_num;
+    for (size_t token = 0; token <= tokens_.size(); ++token) {
+        for (; copy < copies_.size() && copies_[copy].position_ == token; ++copy) {
+            copy_words(copies_[copy]);
         }
 
-        std::string binary_string = inst->get_code(first, second, first_value, second_value);
-        
-        output_ += binary_string;
+        if (token == tokens_.size()) {
+            break;
+        }
+
+        const Operand operands[MAX_OPERANDS] = { tokens_.operand(token, 0), tokens_.operand(token, 1) };
+        const uint32_t address = static_cast<uint32_t>(output_.size());
+
+        if (write_object_) {
+            add_relocations(token, address, use);
+        }
+
+        encode(tokens_.opcode(token), operands, output_);
+
+        line_map_.entries_.push_back({ address, static_cast<uint32_t>(output_.size()) - address, tokens_.lines_[token] });
     }
 
     return OK;
 }
 
-Errors SCompiler::write_file() {
-    std::string header = "v2.0 raw\n";
+void SCompiler::add_relocations(const size_t token, const uint32_t address, size_t& use) {
+    // label uses are in token order
+    for (; use < label_uses_.size() && label_uses_[use].token_ == token; ++use) {
+        const LabelUse& label = label_uses_[use];
+        const uint32_t offset = address + immediate_offset(tokens_.opcode(token), tokens_.kind(token, 0), tokens_.kind(token, 1), label.operand_);
+
+        if (labels_.count(label.name_) > 0) {
+            object_.relocations_.push_back({ offset, RELOC_SECTION });
+            continue;
+        }
+
+        const auto import = imports_.find(label.name_);
 
-    std::stringstream file_data;
-    std::stringstream high_data;
-    std::stringstream low_data;
+        // anything else is a .equ constant, which is the same wherever the object goes
+        if (import != imports_.end()) {
+            object_.relocations_.push_back({ offset, RELOC_IMPORT, import->second });
+        }
+    }
+}
 
-    std::vector<std::string> binary_strings;
-    split(output_, "\n", binary_strings);
+Errors SCompiler::optimize() {
+    Optimizer optimizer;
 
-    for(const auto& line : binary_strings) {
-        std::bitset<8> high_byte {line.substr(0, 8)};
-        std::bitset<8> low_byte {line.substr(8, 8)};
+    optimizer.load(output_, line_map_);
+    optimizer.run();
+    optimizer.emit(output_, line_map_);
+    optimizer_stats_ = optimizer.stats();
 
-        if (output_type_ == HALF_SINGLE_WORD) {
-            high_data << std::setfill('0') << std::setw(2) << std::hex << std::uppercase << high_byte.to_ulong();
-            high_data << " ";
-            low_data << std::setfill('0') << std::setw(2) << std::hex << std::uppercase << low_byte.to_ulong();
-            low_data << " ";
-        } else {
-            file_data << std::setfill('0') << std::setw(2) << std::hex << std::uppercase << high_byte.to_ulong();
-            
-            if (output_type_ == HALF_DUAL_WORD) {
-                file_data << " ";
-            }
+    return OK;
+}
+
+void SCompiler::error(const uint32_t line, const std::string& message) {
+    diagnostics_.push_back({ line, message });
+}
+
+void SCompiler::reset() {
+    tokens_ = TokenList();
+    arena_.reset();
+    labels_.clear();
+    label_uses_.clear();
+    equs_.clear();
+    macros_.clear();
+    copies_.clear();
+    expansions_.clear();
+    imports_.clear();
+    globals_.clear();
+    object_ = ObjectFile();
+    output_.clear();
+    line_map_ = LineMap();
+    diagnostics_.clear();
+    optimizer_stats_ = OptimizerStats();
+}
+
+Errors SCompiler::run_pass(const char* name, Errors (SCompiler::*pass)()) {
+    PassTimer timer { stats_, name };
+    return (this->*pass)();
+}
+
+void SCompiler::count_stats() {
+    stats_->lines_ += source_.line_count();
+    stats_->instructions_ += tokens_.size();
+    stats_->labels_ += labels_.size();
+    stats_->arena_bytes_ = std::max<uint64_t>(stats_->arena_bytes_, arena_.allocated());
+
+    for (size_t token = 0; token < tokens_.size(); ++token) {
+        const Instructions inst = tokens_.opcode(token);
+        stats_->instruction_words_[inst] += instruction_size(inst, tokens_.kind(token, 0), tokens_.kind(token, 1));
+    }
+}
+
+Errors SCompiler::build() {
+    Errors result = run_pass("parse", &SCompiler::parse_file);
+
+    if (result == OK) {
+        result = run_pass("resolve", &SCompiler::resolve_labels);
+    }
+
+    if (result == OK) {
+        result = run_pass("encode", &SCompiler::parse_tree);
+    }
+
+    if (result == OK && stats_ != nullptr) {
+        count_stats();
+    }
+
+    // jumps into other objects are not known until they are linked
+    if (result == OK && optimize_ && write_object_) {
+        error(0, "Objects can not be optimized, the optimizer needs the whole program");
+        result = invalid_instruction;
+    }
+
+    if (result == OK && optimize_) {
+        result = run_pass("optimize", &SCompiler::optimize);
+    }
+
+    if (result == OK && write_object_) {
+        object_.words_ = output_;
+    }
+
+    return result;
+}
+
+CompileResult SCompiler::take_result(const Errors status) {
+    CompileResult result;
+
+    result.ok_ = status == OK;
+    result.words_ = std::move(output_);
+    result.diagnostics_ = std::move(diagnostics_);
+    result.line_map_ = std::move(line_map_);
+    result.optimizer_ = std::move(optimizer_stats_);
+    result.object_ = std::move(object_);
+
+    reset();
+
+    return result;
+}
+
+CompileResult SCompiler::compile_text(const std::string_view source, const std::string& name) {
+    reset();
+
+    source_.view(source);
+    line_map_.source_ = name;
+
+    return take_result(build());
+}
+
+CompileResult SCompiler::compile_file(const std::string& file_name) {
+    reset();
+
+    Errors status = load_file(file_name);
+
+    if (status == OK) {
+        line_map_.source_ = file_name;
+        status = build();
+    }
+
+    return take_result(status);
+}
+
+CompileResult SCompiler::compile_output(const std::string& file_name, CacheEntry& output) {
+    reset();
+
+    {
+        PassTimer timer { stats_, "load" };
 
-            file_data << std::setfill('0') << std::setw(2) << std::hex << std::uppercase << low_byte.to_ulong();
-            file_data << " ";
+        if (load_file(file_name) != OK) {
+            return take_result(file_not_found);
         }
     }
 
-    if (output_type_ == HALF_SINGLE_WORD) {
-        std::ofstream high {"high.hex"};
-        std::ofstream low {"low.hex"};
+    if (stats_ != nullptr) {
+        ++stats_->files_;
+        stats_->source_bytes_ += source_.text().size();
+    }
+
+    CacheKey key;
+
+    // the key is taken before lexing, a hit skips everything after reading the file
+    if (cache_ != nullptr) {
+        PassTimer timer { stats_, "cache" };
+        key = CompileCache::make_key(source_.text(), output_type_, format_, optimize_, write_object_, write_map_ ? file_name : "");
 
-        if (!high.is_open() || !low.is_open()) {
-            std::cout << "Failed to open output files" << '\n';
-            return file_write_error;
+        if (cache_->load(key, output)) {
+            CompileResult result = take_result(OK);
+            result.words_ = output.words_;
+            result.cached_ = true;
+
+            if (stats_ != nullptr) {
+                ++stats_->cached_;
+                stats_->words_ += result.words_.size();
+            }
+
+            return result;
         }
+    }
+
+    line_map_.source_ = file_name;
 
-        high << header;
-        high << high_data.str();
-        high.close();
+    CompileResult result = take_result(build());
 
-        low << header;
-        low << low_data.str();
-        low.close();
+    if (!result.ok_) {
+        return result;
+    }
+
+    PassTimer timer { stats_, "format" };
+    MemorySink images;
+
+    if (write_object_) {
+        std::ostringstream object;
+        result.object_.write(object);
+        images.write("out.o", object.str());
     } else {
-        std::ofstream file {"out.hex"};
+        write_images(result.words_, output_type_, images, format_);
+    }
+
+    if (write_map_) {
+        std::ostringstream map;
+        result.line_map_.write(map);
+        images.write("out.map", map.str());
+    }
 
-        if (!file.is_open()) {
-            std::cout << "Failed to open output file" << '\n';
-            return file_write_error;
+    output.words_ = result.words_;
+    output.images_ = std::move(images.images_);
+
+    if (cache_ != nullptr) {
+        cache_->store(key, output);
+    }
+
+    if (stats_ != nullptr) {
+        stats_->words_ += result.words_.size();
+    }
+
+    return result;
+}
+
+bool SCompiler::write_output(const CacheEntry& output, OutputSink& sink, std::string& failed) {
+    PassTimer timer { stats_, "write" };
+
+    for (const auto& [name, contents] : output.images_) {
+        if (!sink.write(name, contents)) {
+            failed = name;
+            return false;
         }
 
-        file << header;
-        file << file_data.str();
-        file.close();
+        if (stats_ != nullptr) {
+            stats_->bytes_written_ += contents.size();
+        }
     }
 
-    return OK;
+    return true;
 }
 
 int SCompiler::compile(const std::string& filename) {
-    if (load_file(filename) != OK) {
-        return 1;
+    CacheEntry output;
+    const CompileResult result = compile_output(filename, output);
+
+    for (const Diagnostic& diagnostic : result.diagnostics_) {
+        std::cout << diagnostic.message_ << '\n';
     }
 
-    if (parse_file() != OK) {
+    if (!result.ok_) {
         return 1;
     }
 
-    if (parse_tree() != OK) {
-        return 1;
+    if (optimize_ && !result.cached_) {
+        Optimizer::report(result.optimizer_, std::cout);
+    }
+
+    if (cost_report_) {
+        SourceFile source;
+        const CostModel cost { result.words_, result.line_map_, result.optimizer_.register_jumps_ };
+
+        cost.print(std::cout, filename != "-" && source.open(filename) ? &source : nullptr);
     }
 
-    if (write_file() != OK) {
+    FileSink sink;
+    std::string failed;
+
+    if (!write_output(output, sink, failed)) {
+        std::cout << (output_type_ == HALF_SINGLE_WORD && failed != "out.map" ? "Failed to open output files" : "Failed to open output file") << '\n';
         return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+CompileResult compile_source(const std::string_view source, const CompileOptions& options) {
+    SCompiler compiler;
+    compiler.set_optimize(options.optimize_);
+    compiler.set_object(options.object_);
+
+    return compiler.compile_text(source, options.name_);
+}
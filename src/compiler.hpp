@@ -2,27 +2,26 @@
 
 #include <iostream>
 
+#include <cstdint>
+#include <algorithm>
 #include <vector>
 #include <string>
-#include <memory>
 #include <unordered_map>
-#include <fstream>
-#include <sstream>
-#include <bitset>
-#include <iomanip>
-
-enum Types {
-    REG,
-    IMM,
-    REG_IMM,
-    NONE
-};
 
-enum OutputTypes {
-    HALF_DUAL_WORD, // EEPROM which outputs data at address n and n+1, 2 8 bit outputs
-    HALF_SINGLE_WORD, // EEPROM which outputs data at address n so 2 have to be used as data width is 8 bits
-    FULL_SINGLE_WORD // EEPROM which outputs data at address n but data width is 16 bits
-};
+#include "arena.hpp"
+#include "cache.hpp"
+#include "cost.hpp"
+#include "encoder.hpp"
+#include "isa.hpp"
+#include "lexer.hpp"
+#include "linemap.hpp"
+#include "macro.hpp"
+#include "object.hpp"
+#include "optimizer.hpp"
+#include "output.hpp"
+#include "source.hpp"
+#include "stats.hpp"
+#include "tokens.hpp"
 
 enum Errors {
     OK,
@@ -31,371 +30,231 @@ enum Errors {
     invalid_instruction,
     invalid_register,
     invalid_immediate,
+    invalid_label,
 };
 
-enum Instructions {
-    MOV,
-    WR,
-    RD,
-    EXEC,
-    ADD,
-    SUB,
-    JMP,
-    CMP,
-    JE,
-    JNE,
-    HLT
+// an error found while compiling, message_ is the full text the command line prints
+struct Diagnostic {
+    uint32_t line_; // 0 when the message is not about one line
+    std::string message_;
 };
 
-struct Token_Child {
-    Types type_ = NONE;
-    std::string name_ = "";
-    std::string value_ = "";
+struct CompileOptions {
+    bool optimize_ = false;
+
+    // compile to a relocatable object for link_objects instead of a placed program
+    bool object_ = false;
 
-    Token_Child() = default;
-    virtual ~Token_Child() = default;
+    // name recorded as the source of the line map
+    std::string name_;
 };
-using TKCptr = std::shared_ptr<Token_Child>;
 
-struct Token {
-    Instructions type_;
+struct CompileResult {
+    bool ok_ = false;
+    std::vector<Word> words_;
+    std::vector<Diagnostic> diagnostics_;
 
-    std::vector<TKCptr> children_;
+    // rom address to source line
+    LineMap line_map_;
 
-    Token() = delete;
+    // what the optimizer did, empty unless it ran
+    OptimizerStats optimizer_;
 
-    Token(Instructions type, std::vector<TKCptr> children) {
-        type_ = type;
-        children_ = children;
-    }
+    // exports, imports and relocations of words_ when compiling to an object
+    ObjectFile object_;
 
-    virtual ~Token() = default;
+    // replayed from the cache, only words_ is filled in
+    bool cached_ = false;
 };
-using TKptr = std::shared_ptr<Token>;
 
-struct Register : public Token_Child {
+// labels, unresolved uses and open output files of a compile_stream, kept across chunks
+struct StreamState;
 
-    Register() = delete;
+class SCompiler {
+    private:
+        SourceFile source_;
 
-    Register(Types type, const std::string& name) {
-        type_ = type;
-        name_ = name;
-    }
-};
-using REGptr = std::shared_ptr<Register>;
+        // owns the token arrays, everything parsed is freed with the compiler
+        Arena arena_;
+        TokenList tokens_;
 
-struct Immediate : public Token_Child {
+        // label name (a view of the source) to the index of the item (token or copy) it points at
+        std::unordered_map<std::string_view, size_t> labels_;
+        std::vector<LabelUse> label_uses_;
 
-    Immediate() = delete;
+        // .equ constants and .macro definitions, by name
+        std::unordered_map<std::string_view, uint16_t> equs_;
+        std::unordered_map<std::string_view, Macro> macros_;
 
-    Immediate(Types type, const std::string& value) {
-        type_ = type;
-        value_ = value;
-    }
-};
-using IMMptr = std::shared_ptr<Immediate>;
+        // words written again instead of parsed again, in program order
+        std::vector<WordCopy> copies_;
 
-struct InstructionCode {
-    public:
-        virtual std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) = 0;
-        virtual ~InstructionCode() = default;
-};
-using InstPtr = std::shared_ptr<InstructionCode>;
+        // items of the first expansion of each macro and argument list
+        std::unordered_map<std::string, std::pair<size_t, size_t>> expansions_;
 
-struct RegisterCode {
-    std::string name_;
-    std::string from_bus_;
-    std::string to_bus_;
-
-    RegisterCode() = delete;
-
-    RegisterCode(const std::string& name, const std::string& from_bus, const std::string& to_bus) {
-        name_ = name;
-        from_bus_ = from_bus;
-        to_bus_ = to_bus;
-    }
-};
-
-struct Instruction {
-    std::string name_;
+        // .extern names and their index in object_.imports_, and .global names with their line
+        std::unordered_map<std::string_view, uint32_t> imports_;
+        std::vector<std::pair<std::string_view, uint32_t>> globals_;
+        ObjectFile object_;
+        std::vector<Word> output_;
+        OutputTypes output_type_;
+        OutputFormats format_ = FORMAT_RAW;
 
-    int children_;
-    std::vector<Types> child_types_;
-    Instructions type_;
+        LineMap line_map_;
+        bool write_map_ = false;
+        bool optimize_ = false;
+        bool cost_report_ = false;
+        bool write_object_ = false;
 
-    Instruction() = delete;
+        CompileCache* cache_ = nullptr;
+        CompileStats* stats_ = nullptr;
 
-    Instruction(const std::string& name, int children, std::vector<Types> child_types, Instructions type) {
-        name_ = name;
-        children_ = children;
-        child_types_ = child_types;
-        type_ = type;
-    }
+        std::vector<Diagnostic> diagnostics_;
+        OptimizerStats optimizer_stats_;
 
-    virtual ~Instruction() = default;
-};
+        void error(const uint32_t line, const std::string& message);
+        void reset();
 
-const std::unordered_map<std::string, RegisterCode> register_codes = {
-    {"a", RegisterCode("a", "00001", "00001")},
-    {"b", RegisterCode("b", "00011", "00010")},
-    {"c", RegisterCode("c", "01000", "00111")},
-    {"acc", RegisterCode("acc", "N_ALWD", "00100")},
-    {"flgs", RegisterCode("flgs", "N_ALWD", "00101")},
-    {"lgc", RegisterCode("lgc", "N_ALWD", "01000")},
-};
+        // parse_file through optimize on the loaded source
+        Errors build();
 
-class SCompiler {
-    private:
-        const std::unordered_map<std::string, Instruction> instructions_ = {
-            {"mov",  Instruction("mov", 2, {REG, REG_IMM}, MOV)},
-            {"wr", Instruction("wr", 2, {REG_IMM, REG}, WR)},
-            {"rd", Instruction("wr", 2, {REG_IMM, REG}, RD)},
-            {"exec", Instruction("exec", 1, {REG_IMM}, EXEC)},
-            {"add", Instruction("add", 2, {REG_IMM, REG_IMM}, ADD)},
-            {"sub", Instruction("sub", 2, {REG_IMM, REG_IMM}, SUB)},
-            {"cmp", Instruction("cmp", 2, {REG_IMM, REG_IMM}, CMP)},
-            {"jmp", Instruction("jmp", 1, {REG_IMM}, JMP)},
-            {"je", Instruction("je", 1, {REG_IMM}, JE)},
-            {"jne", Instruction("jne", 1, {REG_IMM}, JNE)},
-            {"hlt", Instruction("hlt", 0, {}, HLT)}
-        };
+        // runs one pass of build, timed when stats are collected
+        Errors run_pass(const char* name, Errors (SCompiler::*pass)());
 
-        const std::unordered_map<std::string, Register> registers_ = {
-            {"a", Register(REG, "a")},
-            {"b", Register(REG, "b")},
-            {"c", Register(REG, "c")},
-            {"acc", Register(REG, "acc")},
-            {"flgs", Register(REG, "flgs")},
-            {"lgc", Register(REG, "lgc")},
-        };
+        // adds the counts of the encoded program to stats_
+        void count_stats();
 
-        std::vector<std::string> lines_;
-        std::vector<TKptr> tokens_;
-        std::string output_;
-        OutputTypes output_type_;
+        // moves the output of the last build into a result and clears the compiler for the next one
+        CompileResult take_result(const Errors status);
 
         Errors load_file(const std::string& file_name);
         Errors parse_file();
-        Errors parse_tree();
-        Errors write_file();
-        Errors locate_instruction(const std::string& inst_name);
-    
-        TKCptr make_token(Instruction inst, const std::string& reg, const std::string& imm, const int token_num);
-        InstPtr get_instruction_struct(const Instructions& inst);
-        
-        void split (std::string str, const std::string& delim, std::vector<std::string>& out);
-
-        bool is_valid_reg(const std::string& reg);
-        bool is_valid_imm(const std::string& imm);
-    public:
-        // TODO: Set most methods to private;
-        SCompiler() {
-            output_type_ = HALF_DUAL_WORD;
-        };
 
-        static std::string htos(const std::string& hex_value);
-        bool set_output(const std::string& format);
-        int compile(const std::string& file_name);
+        // reports an invalid label name on the line
+        bool check_label(const LexToken& line);
 
-        ~SCompiler() = default;
-};
+        // checks the instruction on the line and appends it to tokens_
+        Errors parse_instruction(const LexToken& line);
 
-struct MOV_Inst : public InstructionCode {
-    std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) override {
-        if (first == REG && second == REG) {
-            return "0000" + register_codes.at(first_val).from_bus_ + register_codes.at(second_val).to_bus_ + "00\n";
-        } else if (first == REG && second == IMM) {
-            return "0000" + register_codes.at(first_val).from_bus_ + "0000001\n" + SCompiler::htos(second_val) + "\n";
+        // index the next token or copy gets
+        size_t next_item() const {
+            return tokens_.size() + copies_.size();
         }
 
-        return "error";
-    }
+        // a line of the source or of a body, args is the macro being expanded and depth the number of bodies around the line
+        Errors parse_line(const LexToken& line, LineReader& reader, const MacroArgs* args, uint32_t depth);
+        Errors parse_directive(const LexToken& line, LineReader& reader, const MacroArgs* args, uint32_t depth);
+        Errors expand_macro(const LexToken& line, const Macro& macro, const MacroArgs* args, uint32_t depth);
 
-    virtual ~MOV_Inst() = default;
-};
-
-struct HLT_Inst : public InstructionCode {
-    std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) override {
-        return SCompiler::htos("0x7C") + "\n";
-    }
+        // reads the lines up to the .endr or .endm closing the .rep or .macro on start
+        Errors read_body(const LexToken& start, LineReader& reader, std::vector<LexToken>& body);
 
-    virtual ~HLT_Inst() = default;
-};
+        // a hex immediate or a .equ constant
+        bool constant_value(const std::string_view operand, uint16_t& value, const uint32_t line);
 
-struct WR_Inst : public InstructionCode {
-    std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) override {
-        // load address into mar (from imm or from reg)
-        std::string mar_code = "";
-        std::string wr_code = "";
+        // writes items first to end count more times at the current end of the program
+        void repeat_items(size_t first, size_t end, uint32_t count, uint32_t line);
 
-        if (first == REG) {
-            mar_code = "000000111" + register_codes.at(first_val).to_bus_ + "00\n";
-        } else if (first == IMM) {
-            mar_code = "0000001110000001\n" + SCompiler::htos(first_val) + "\n";
-        }
+        // appends the words, line map entries and relocations of an earlier stretch of output_
+        void copy_words(const WordCopy& words);
 
-        wr_code = "100000010" + register_codes.at(second_val).to_bus_ + "11\n";
-        
-        return mar_code + wr_code;
-    }
-
-    virtual ~WR_Inst() = default;
-};
-
-struct RD_Inst : public InstructionCode {
-    std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) override {
-        // load address into mar (from imm or from reg)
-        std::string mar_code = "";
-        std::string rd_code = "";
+        // records the immediates of the token that hold an address, use is the next label use to look at
+        void add_relocations(size_t token, uint32_t address, size_t& use);
+        Errors resolve_labels();
+        Errors parse_tree();
+        Errors optimize();
 
-        if (first == REG) {
-            mar_code = "000000111" + register_codes.at(first_val).to_bus_ + "00\n";
-        } else if (first == IMM) {
-            mar_code = "0000001110000001\n" + SCompiler::htos(first_val) + "\n";
-        }
+        // parses, resolves, encodes and writes the complete lines of one chunk of a streamed source
+        Errors stream_chunk(const std::string_view chunk, StreamState& state);
 
-        rd_code = "0000" + register_codes.at(second_val).from_bus_ + "01001" + "00\n";
-        
-        return mar_code + rd_code;
-    }
+        // checks operand token_num of the token against inst and stores its kind and value
+        bool parse_operand(const InstructionInfo& inst, const std::string_view arg, const size_t token, const uint8_t token_num);
 
-    virtual ~RD_Inst() = default;
-};
+        bool is_valid_reg(const std::string_view reg);
+        bool is_valid_imm(const std::string_view imm, uint16_t& value, const uint32_t line);
+        bool is_valid_label(const std::string_view label);
+    public:
+        // TODO: Set most methods to private;
+        SCompiler() {
+            output_type_ = HALF_DUAL_WORD;
+        };
 
-struct EXEC_Inst : public InstructionCode {
-    std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) override {
-        // load address into mar (from imm or from reg)
-        std::string mar_code = "";
-        std::string rd_code = "";
+        bool set_output(const std::string& format);
 
-        if (first == REG) {
-            mar_code = "000000111" + register_codes.at(first_val).to_bus_ + "00\n";
-        } else if (first == IMM) {
-            mar_code = "0000001110000001\n" + SCompiler::htos(first_val) + "\n";
+        void set_output(OutputTypes type) {
+            output_type_ = type;
         }
 
-        rd_code = "0000010010100100\n";
-        
-        return mar_code + rd_code;
-    }
-
-    virtual ~EXEC_Inst() = default;
-};
-
-struct ADD_Inst : public InstructionCode {
-    std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) override {
-        std::string first_int = "";
-        std::string second_int = "";
-
-        if (first == REG) {
-            first_int = "000000100" + register_codes.at(first_val).to_bus_ +  "00\n";
-        } else if (first == IMM) {
-            first_int = "0000001000000001\n" + SCompiler::htos(first_val) + "\n";
+        OutputTypes output_type() const {
+            return output_type_;
         }
 
-        if (second == REG) {
-            second_int = "000100000" + register_codes.at(second_val).to_bus_ + "00\n";
-        } else if (second == IMM) {
-            second_int = "0001000000000001\n" + SCompiler::htos(second_val) + "\n";
+        void set_format(OutputFormats format) {
+            format_ = format;
         }
 
-        return first_int + second_int;
-    }
-
-    virtual ~ADD_Inst() = default;
-};
-
-struct SUB_Inst : public InstructionCode {
-    std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) override {
-        std::string first_int = "";
-        std::string second_int = "";
-
-        if (first == REG) {
-            first_int = "000000100" + register_codes.at(second_val).to_bus_ +  "00\n";
-        } else if (first == IMM) {
-            first_int = "0000001000000001\n" + SCompiler::htos(second_val) + "\n";
+        OutputFormats format() const {
+            return format_;
         }
 
-        if (second == REG) {
-            second_int = "001000000" + register_codes.at(first_val).to_bus_ + "00";
-        } else if (second == IMM) {
-            second_int = "0010000000000001\n" + SCompiler::htos(first_val) + "\n";
+        // also write out.map, which maps rom addresses back to source lines
+        void set_line_map(bool enabled) {
+            write_map_ = enabled;
         }
 
-        return first_int + second_int;
-    }
-
-    virtual ~SUB_Inst() = default;
-};
-
-struct JMP_Inst : public InstructionCode {
-    std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) override {
-        std::string code = "";
-
-        if (first == REG) {
-            code = "000000110" + register_codes.at(first_val).to_bus_ + "00\n";
-        } else if (first == IMM) {
-            code = "0000001100000001\n" + SCompiler::htos(first_val) + "\n";
+        // run the optimizer over the encoded words before writing them
+        void set_optimize(bool enabled) {
+            optimize_ = enabled;
         }
 
-        return code;
-    }
-
-    virtual ~JMP_Inst() = default;
-};
-
-struct COMP_Inst : public InstructionCode {
-    std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) override {
-        std::string first_int = "";
-        std::string second_int = "";
-
-        if (second == REG) {
-            std::cout << "first is reg" << std::endl;
-            first_int = "000000100" + register_codes.at(second_val).to_bus_ +  "00\n";
-        } else if (second == IMM) {
-            first_int = "0000001000000001\n" + SCompiler::htos(second_val) + "\n";
+        // print the words and cycles of every line, block and loop after compiling
+        void set_cost_report(bool enabled) {
+            cost_report_ = enabled;
         }
 
-        if (first == REG) {
-            second_int = "001100000" + register_codes.at(first_val).to_bus_ + "00\n";
-        } else if (first == IMM) {
-            second_int = "0011000000000001\n" + SCompiler::htos(first_val) + "\n";
+        // write a relocatable object (out.o) for the linker instead of the images
+        void set_object(bool enabled) {
+            write_object_ = enabled;
         }
 
-        return first_int + second_int;
-    }
+        // looked up before compiling files, nullptr compiles everything
+        void set_cache(CompileCache* cache) {
+            cache_ = cache;
+        }
 
-    virtual ~COMP_Inst() = default;
-};
+        // passes and counts of every compile are added to stats, nullptr collects nothing
+        void set_stats(CompileStats* stats) {
+            stats_ = stats;
+        }
 
-struct JE_Inst : public InstructionCode {
-    std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) override {
-        std::string code = "";
+        // compiles the file and writes the images (and out.map) to the working directory
+        int compile(const std::string& file_name);
 
-        if (first == REG) {
-            code = "000011111" + register_codes.at(first_val).to_bus_ + "00\n";
-        } else if (first == IMM) {
-            code = "0000111110000001\n" + SCompiler::htos(first_val) + "\n";
-        }
+        // compiles the file into images (and out.map when the line map is on), or replays them from the cache
+        CompileResult compile_output(const std::string& file_name, CacheEntry& output);
 
-        return code;
-    }
+        // hands every image of output to sink, failed is the name of the image that could not be written
+        bool write_output(const CacheEntry& output, OutputSink& sink, std::string& failed);
 
-    virtual ~JE_Inst() = default;
-};
+        /*
+         * Same output as compile, but the source is read, encoded and written a chunk at a time,
+         * so memory does not grow with the program. Forward label uses are patched into the
+         * images once their label turns up. Cannot be combined with the optimizer or the cache.
+         */
+        int compile_stream(const std::string& file_name);
 
-struct JNE_Inst : public InstructionCode {
-    std::string get_code(const Types first, const Types second, const std::string& first_val, const std::string& second_val) override {
-        std::string code = "";
+        // compiles the file without writing anything
+        CompileResult compile_file(const std::string& file_name);
 
-        if (first == REG) {
-            code = "000011110" + register_codes.at(first_val).to_bus_ + "00\n";
-        } else if (first == IMM) {
-            code = "0000111100000001\n" + SCompiler::htos(first_val) + "\n";
-        }
+        // compiles source held in memory, source only has to stay alive for the call
+        CompileResult compile_text(const std::string_view source, const std::string& name = "");
 
-        return code;
-    }
+        ~SCompiler() = default;
+};
 
-    virtual ~JNE_Inst() = default;
-};
\ No newline at end of file
+/*
+ * Library entry point: nothing is read from or written to disk and nothing is shared between
+ * calls, so compiles can run concurrently on separate threads. Pass the result's words to
+ * write_images with a sink to get the images.
+ */
+CompileResult compile_source(const std::string_view source, const CompileOptions& options = CompileOptions());
@@ -0,0 +1,373 @@
+#include "cost.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+static bool is_exec(const MicroOp& op) {
+    return op.word_ == make_word(ALU_NONE, BUS_RAM, BUS_RAM, FLAG_NONE);
+}
+
+static bool is_jump(const MicroOp& op) {
+    const uint16_t dest = word_dest(op.word_);
+
+    return word_alu(op.word_) == ALU_NONE && (dest == BUS_PC || dest == BUS_JE || dest == BUS_JNE);
+}
+
+// exec fetches the word it runs from ram, and its immediate when it has one
+static CycleRange op_cycles(const MicroOp& op) {
+    if (is_exec(op)) {
+        return { 2, 3 };
+    }
+
+    return { op.size(), op.size() };
+}
+
+static void add(CycleRange& total, const CycleRange& cycles) {
+    total.best_ += cycles.best_;
+    total.worst_ += cycles.worst_;
+}
+
+static std::string format_cycles(const CycleRange& cycles) {
+    if (cycles.best_ == cycles.worst_) {
+        return std::to_string(cycles.worst_);
+    }
+
+    return std::to_string(cycles.best_) + "-" + std::to_string(cycles.worst_);
+}
+
+CostModel::CostModel(const std::vector<Word>& words, const LineMap& map, const std::vector<std::pair<uint32_t, uint32_t>>& register_jumps) {
+    graph_.analyze(words, map, register_jumps);
+
+    const std::vector<MicroOp>& ops = graph_.ops();
+    const std::vector<BasicBlock>& blocks = graph_.blocks();
+
+    uint32_t last_line = 0;
+
+    for (const MicroOp& op : ops) {
+        last_line = std::max(last_line, op.line_);
+
+        if (is_exec(op) || (is_jump(op) && !op.has_imm_ && op.target_ < 0)) {
+            ++indirect_;
+        }
+    }
+
+    lines_.resize(last_line + 1);
+
+    for (const MicroOp& op : ops) {
+        lines_[op.line_].words_ += op.size();
+        add(lines_[op.line_].cycles_, op_cycles(op));
+    }
+
+    block_words_.resize(blocks.size());
+    block_cycles_.resize(blocks.size());
+    block_loop_.assign(blocks.size(), -1);
+
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        for (size_t i = blocks[b].first_; i <= blocks[b].last_; ++i) {
+            block_words_[b] += ops[i].size();
+            add(block_cycles_[b], op_cycles(ops[i]));
+        }
+    }
+
+    order_ = reverse_postorder(blocks);
+    position_.assign(blocks.size(), SIZE_MAX);
+
+    for (size_t i = 0; i < order_.size(); ++i) {
+        position_[order_[i]] = i;
+    }
+
+    loops_ = find_loops(blocks);
+
+    // outer loops come first, so the innermost loop of a block is the last one holding it
+    for (size_t l = 0; l < loops_.size(); ++l) {
+        for (const size_t block : loops_[l].blocks_) {
+            block_loop_[block] = static_cast<int64_t>(l);
+        }
+    }
+
+    cost_loops();
+    cost_regions();
+}
+
+uint32_t CostModel::line_of(const size_t block) const {
+    return graph_.ops()[graph_.blocks()[block].first_].line_;
+}
+
+std::string CostModel::describe_exit(const size_t block) const {
+    const MicroOp& last = graph_.ops()[graph_.blocks()[block].last_];
+
+    if (word_src(last.word_) == BUS_HLT) {
+        return "hlt on line " + std::to_string(last.line_);
+    }
+
+    if (is_jump(last) && !last.has_imm_ && last.target_ < 0) {
+        return "jump through a register on line " + std::to_string(last.line_);
+    }
+
+    if (is_jump(last)) {
+        return "jump out of the program on line " + std::to_string(last.line_);
+    }
+
+    return "end of the program";
+}
+
+std::vector<CycleRange> CostModel::walk(const size_t entry, const std::function<bool(size_t)>& inside, std::vector<bool>& reached) const {
+    const std::vector<BasicBlock>& blocks = graph_.blocks();
+
+    std::vector<CycleRange> reach(blocks.size());
+    reached.assign(blocks.size(), false);
+
+    reach[entry] = block_cycles_[entry];
+    reached[entry] = true;
+
+    // in reverse postorder every block comes after the blocks that reach it by a forward edge
+    for (size_t i = position_[entry]; i < order_.size(); ++i) {
+        const size_t block = order_[i];
+
+        if (!reached[block]) {
+            continue;
+        }
+
+        for (const size_t successor : blocks[block].successors_) {
+            if (position_[successor] <= i || !inside(successor)) {
+                continue;
+            }
+
+            const CycleRange through = { reach[block].best_ + block_cycles_[successor].best_, reach[block].worst_ + block_cycles_[successor].worst_ };
+
+            if (!reached[successor]) {
+                reach[successor] = through;
+                reached[successor] = true;
+                continue;
+            }
+
+            reach[successor].best_ = std::min(reach[successor].best_, through.best_);
+            reach[successor].worst_ = std::max(reach[successor].worst_, through.worst_);
+        }
+    }
+
+    return reach;
+}
+
+void CostModel::cost_loops() {
+    const std::vector<BasicBlock>& blocks = graph_.blocks();
+
+    for (const NaturalLoop& loop : loops_) {
+        std::vector<bool> reached;
+        const std::vector<CycleRange> reach = walk(loop.header_, [&](size_t block) { return loop.contains(block); }, reached);
+
+        LoopCost cost;
+        bool first = true;
+
+        // an iteration runs from the start of the header to the end of a latch
+        for (const size_t latch : loop.latches_) {
+            if (!reached[latch]) {
+                continue;
+            }
+
+            cost.iteration_.best_ = first ? reach[latch].best_ : std::min(cost.iteration_.best_, reach[latch].best_);
+            cost.iteration_.worst_ = std::max(cost.iteration_.worst_, reach[latch].worst_);
+            first = false;
+        }
+
+        for (const size_t block : loop.blocks_) {
+            cost.exits_ = cost.exits_ || blocks[block].exits_;
+
+            for (const size_t successor : blocks[block].successors_) {
+                cost.exits_ = cost.exits_ || !loop.contains(successor);
+            }
+        }
+
+        loop_costs_.push_back(cost);
+    }
+}
+
+void CostModel::cost_regions() {
+    const std::vector<BasicBlock>& blocks = graph_.blocks();
+
+    if (order_.empty()) {
+        return;
+    }
+
+    // the start of the program and every block outside the loops that a loop exits to
+    std::vector<size_t> entries;
+
+    if (block_loop_[order_[0]] < 0) {
+        entries.push_back(order_[0]);
+    }
+
+    for (const size_t block : order_) {
+        if (block_loop_[block] < 0) {
+            continue;
+        }
+
+        for (const size_t successor : blocks[block].successors_) {
+            if (block_loop_[successor] < 0 && std::find(entries.begin(), entries.end(), successor) == entries.end()) {
+                entries.push_back(successor);
+            }
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [&](size_t a, size_t b) {
+        return position_[a] < position_[b];
+    });
+
+    auto outside_loops = [&](size_t block) {
+        return block_loop_[block] < 0;
+    };
+
+    for (const size_t entry : entries) {
+        std::vector<bool> reached;
+        const std::vector<CycleRange> reach = walk(entry, outside_loops, reached);
+
+        RegionCost region { entry, {}, {} };
+        bool first = true;
+
+        auto end_at = [&](const CycleRange& cycles, const std::string& what) {
+            region.cycles_.best_ = first ? cycles.best_ : std::min(region.cycles_.best_, cycles.best_);
+            region.cycles_.worst_ = std::max(region.cycles_.worst_, cycles.worst_);
+            first = false;
+
+            if (std::find(region.ends_.begin(), region.ends_.end(), what) == region.ends_.end()) {
+                region.ends_.push_back(what);
+            }
+        };
+
+        for (size_t block = 0; block < blocks.size(); ++block) {
+            if (!reached[block]) {
+                continue;
+            }
+
+            if (blocks[block].exits_) {
+                end_at(reach[block], describe_exit(block));
+            }
+
+            for (const size_t successor : blocks[block].successors_) {
+                if (!outside_loops(successor)) {
+                    end_at(reach[block], "the loop at line " + std::to_string(line_of(successor)));
+                } else if (position_[successor] <= position_[block]) {
+                    // a cycle with more than one way in is not a natural loop, the bound stops at it
+                    end_at(reach[block], "a jump back to line " + std::to_string(line_of(successor)));
+                }
+            }
+        }
+
+        regions_.push_back(region);
+    }
+}
+
+void CostModel::print(std::ostream& out, const SourceFile* source) const {
+    const std::vector<BasicBlock>& blocks = graph_.blocks();
+
+    uint32_t words = 0;
+
+    for (const LineCost& line : lines_) {
+        words += line.words_;
+    }
+
+    out << std::dec << std::setfill(' ');
+    out << "cost: " << words << " words, " << blocks.size() << (blocks.size() == 1 ? " block, " : " blocks, ") << loops_.size()
+        << (loops_.size() == 1 ? " loop" : " loops") << ", one cycle per word fetched\n\n";
+
+    out << "lines:\n";
+    out << "  " << std::setw(6) << "line" << std::setw(7) << "words" << std::setw(8) << "cycles" << "  source\n";
+
+    const size_t line_count = source != nullptr ? std::max(source->line_count(), lines_.size() - 1) : lines_.size() - 1;
+
+    for (size_t line = 1; line <= line_count; ++line) {
+        const bool code = line < lines_.size() && lines_[line].words_ > 0;
+
+        if (!code && source == nullptr) {
+            continue;
+        }
+
+        out << "  " << std::setw(6) << line;
+
+        if (code) {
+            out << std::setw(7) << lines_[line].words_ << std::setw(8) << format_cycles(lines_[line].cycles_);
+        } else {
+            out << std::setw(15) << "";
+        }
+
+        if (source != nullptr && line <= source->line_count()) {
+            out << "  " << source->line(line);
+        }
+
+        out << '\n';
+    }
+
+    out << "\nblocks:\n";
+    out << "  " << std::setw(8) << "block" << std::setw(14) << "lines" << std::setw(7) << "words" << std::setw(8) << "cycles" << "  next\n";
+
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        const std::vector<MicroOp>& ops = graph_.ops();
+        const std::string lines = std::to_string(ops[blocks[b].first_].line_) + "-" + std::to_string(ops[blocks[b].last_].line_);
+
+        std::string next;
+
+        for (const size_t successor : blocks[b].successors_) {
+            next += (next.empty() ? "B" : ", B") + std::to_string(successor);
+        }
+
+        if (blocks[b].exits_) {
+            next += next.empty() ? "exit" : ", exit";
+        }
+
+        if (position_[b] == SIZE_MAX) {
+            next += " (unreachable)";
+        }
+
+        out << "  " << std::setw(8) << ("B" + std::to_string(b)) << std::setw(14) << lines << std::setw(7) << block_words_[b]
+            << std::setw(8) << format_cycles(block_cycles_[b]) << "  " << next << '\n';
+    }
+
+    out << "\nloops:\n";
+
+    if (loops_.empty()) {
+        out << "  none\n";
+    }
+
+    for (size_t l = 0; l < loops_.size(); ++l) {
+        const NaturalLoop& loop = loops_[l];
+        const LoopCost& cost = loop_costs_[l];
+
+        uint32_t first = UINT32_MAX;
+        uint32_t last = 0;
+
+        for (const size_t block : loop.blocks_) {
+            first = std::min(first, graph_.ops()[blocks[block].first_].line_);
+            last = std::max(last, graph_.ops()[blocks[block].last_].line_);
+        }
+
+        const bool nested = std::any_of(loops_.begin(), loops_.end(), [&](const NaturalLoop& inner) {
+            return inner.parent_ == static_cast<int64_t>(l);
+        });
+
+        out << "  " << std::string((loop.depth_ - 1) * 2, ' ') << "lines " << first << "-" << last << " (B" << loop.header_ << ", "
+            << loop.blocks_.size() << (loop.blocks_.size() == 1 ? " block" : " blocks") << "): " << format_cycles(cost.iteration_)
+            << " cycles per iteration" << (nested ? " with one pass through the loops inside" : "")
+            << (cost.exits_ ? "" : ", never exits") << '\n';
+    }
+
+    out << "\nloop free code:\n";
+
+    if (regions_.empty()) {
+        out << "  none\n";
+    }
+
+    for (const RegionCost& region : regions_) {
+        out << "  from line " << line_of(region.entry_) << ": " << format_cycles(region.cycles_) << (region.cycles_.worst_ == 1 ? " cycle to " : " cycles to ");
+
+        for (size_t i = 0; i < region.ends_.size(); ++i) {
+            out << (i == 0 ? "" : (i + 1 == region.ends_.size() ? " or " : ", ")) << region.ends_[i];
+        }
+
+        out << '\n';
+    }
+
+    if (indirect_ > 0) {
+        out << "\nnote: " << indirect_ << " exec or register jump words can go anywhere, exec is counted as falling through "
+            << "and a register jump as leaving the program\n";
+    }
+}
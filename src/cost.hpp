@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "isa.hpp"
+#include "linemap.hpp"
+#include "optimizer.hpp"
+#include "source.hpp"
+
+// cycles along the cheapest and the most expensive way through some code
+struct CycleRange {
+    uint64_t best_ = 0;
+    uint64_t worst_ = 0;
+};
+
+/*
+ * Static timing of an encoded program. Every word fetched takes one cycle, the way spl-emu
+ * counts them, so the cost of each line, basic block and loop iteration is known without
+ * running anything. exec also fetches the ram word it runs, which is one or two words, so its
+ * lines get a range. Jumps through a register can land anywhere and are treated as leaving
+ * the program, unless -O hoisted their target into the register and reported where they land.
+ */
+class CostModel {
+    private:
+        struct LineCost {
+            uint32_t words_ = 0;
+            CycleRange cycles_;
+        };
+
+        // code outside every loop, from entry_ until it stops or enters a loop
+        struct RegionCost {
+            size_t entry_;
+            CycleRange cycles_;
+            std::vector<std::string> ends_;
+        };
+
+        struct LoopCost {
+            CycleRange iteration_;
+            bool exits_ = false;
+        };
+
+        Optimizer graph_;
+        std::vector<NaturalLoop> loops_;
+
+        std::vector<size_t> order_;
+        std::vector<size_t> position_; // index in order_, SIZE_MAX for blocks nothing reaches
+
+        std::vector<uint32_t> block_words_;
+        std::vector<CycleRange> block_cycles_;
+        std::vector<int64_t> block_loop_; // innermost loop of each block, -1 outside every loop
+
+        std::vector<LineCost> lines_;
+        std::vector<LoopCost> loop_costs_;
+        std::vector<RegionCost> regions_;
+        uint32_t indirect_ = 0;
+
+        uint32_t line_of(size_t block) const;
+
+        // what a block that leaves the program does: hlt, a jump through a register or running off the end
+        std::string describe_exit(size_t block) const;
+
+        /*
+         * Cycles from the start of entry to the end of every block reachable from it through
+         * blocks inside accepts. Edges back to an earlier block are not followed, so a loop
+         * nested in the code is counted once. reached marks the blocks it got to.
+         */
+        std::vector<CycleRange> walk(size_t entry, const std::function<bool(size_t)>& inside, std::vector<bool>& reached) const;
+
+        void cost_loops();
+        void cost_regions();
+
+    public:
+        CostModel() = delete;
+
+        // words and map as compiled (after -O when it ran), register_jumps from the OptimizerStats of that run
+        CostModel(const std::vector<Word>& words, const LineMap& map, const std::vector<std::pair<uint32_t, uint32_t>>& register_jumps = {});
+
+        // source, when given, prints the text of each line
+        void print(std::ostream& out, const SourceFile* source) const;
+
+        ~CostModel() = default;
+};
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <set>
+
+#include "batch_emu.hpp"
+#include "emulator.hpp"
+#include "profiler.hpp"
+
+static void print_usage(const char* name) {
+    std::cout << "Usage: " << name << " <options?> <image> <low image?>" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -f <type>     image layout: S16, S8, D8 (detected when omitted, S8 takes high and low images)" << std::endl;
+    std::cout << "  -c <cycles>   stop after this many cycles (default 100000000)" << std::endl;
+    std::cout << "  -p <n>        profile the run and print the n hottest lines and loops" << std::endl;
+    std::cout << "  -m <map>      line map written by splc -g, used to report source lines" << std::endl;
+    std::cout << "  --collapsed <file>  write the profile as collapsed stacks for flamegraph.pl" << std::endl;
+    std::cout << "  --batch <vectors>   run one instance per line of a test vector file, in lockstep across every core" << std::endl;
+    std::cout << "  -j <threads>  threads for --batch (default one per core)" << std::endl;
+}
+
+// the whole argument has to be a decimal number
+template <typename T>
+static bool parse_count(const char* text, T& out) {
+    const char* end = text + std::char_traits<char>::length(text);
+    const auto [last, error] = std::from_chars(text, end, out);
+
+    return error == std::errc() && last == end && last != text;
+}
+
+static bool parse_type(const std::string& format, OutputTypes& type) {
+    if (format == "D8") {
+        type = HALF_DUAL_WORD;
+    } else if (format == "S8") {
+        type = HALF_SINGLE_WORD;
+    } else if (format == "S16") {
+        type = FULL_SINGLE_WORD;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static void print_state(const Emulator& emulator, double seconds) {
+    const CpuState& state = emulator.state();
+    const char* names[R_COUNT] = { "a", "b", "c", "acc", "flgs", "lgc", "numbr", "mar", "cbus_cache" };
+
+    std::cout << "stopped: " << halt_reason_name(state.reason_);
+
+    if (state.reason_ == invalid_word) {
+        std::cout << " (0x" << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << state.bad_word_ << std::dec << ")";
+    }
+
+    std::cout << '\n';
+    std::cout << "cycles: " << state.cycles_ << " in " << seconds * 1000 << " ms";
+
+    if (seconds > 0) {
+        std::cout << " (" << state.cycles_ / seconds / 1e6 << " MHz)";
+    }
+
+    std::cout << "\n\nregisters:\n";
+    std::cout << std::hex << std::uppercase << std::setfill('0');
+
+    for (int reg = 0; reg < R_COUNT; ++reg) {
+        std::cout << "  " << std::left << std::setw(11) << std::setfill(' ') << names[reg] << std::right
+                  << "0x" << std::setw(4) << std::setfill('0') << state.regs_[reg] << '\n';
+    }
+
+    std::cout << "  " << std::left << std::setw(11) << std::setfill(' ') << "pc" << std::right
+              << "0x" << std::setw(4) << std::setfill('0') << state.pc_ << '\n';
+
+    // only rows holding something other than zero are printed
+    std::cout << "\nram (non zero rows):\n";
+
+    for (size_t row = 0; row < RAM_WORDS; row += 8) {
+        bool empty = true;
+
+        for (size_t i = row; i < row + 8; ++i) {
+            empty = empty && state.ram_[i] == 0;
+        }
+
+        if (empty) {
+            continue;
+        }
+
+        std::cout << "  " << std::setw(4) << row << ":";
+
+        for (size_t i = row; i < row + 8; ++i) {
+            std::cout << ' ' << std::setw(4) << state.ram_[i];
+        }
+
+        std::cout << '\n';
+    }
+
+    std::cout << std::dec;
+}
+
+static void print_batch(const std::vector<TestVector>& vectors, const BatchReport& report) {
+    const char* names[R_COUNT] = { "a", "b", "c", "acc", "flgs", "lgc", "numbr", "mar", "cbus_cache" };
+
+    std::map<HaltReasons, size_t> reasons;
+    std::set<std::vector<uint64_t>> states;
+    uint64_t cycles = 0;
+    uint64_t min_cycles = UINT64_MAX;
+    uint64_t max_cycles = 0;
+    size_t checked = 0;
+    size_t failed = 0;
+
+    std::cout << std::hex << std::uppercase << std::setfill('0');
+
+    for (size_t i = 0; i < report.instances_.size(); ++i) {
+        const InstanceResult& result = report.instances_[i];
+        const TestVector& vector = vectors[i];
+
+        std::cout << std::dec << "#" << i << " (line " << vector.line_ << "): " << halt_reason_name(result.reason_);
+
+        if (result.reason_ == invalid_word) {
+            std::cout << " (0x" << std::hex << std::setw(4) << result.bad_word_ << std::dec << ")";
+        }
+
+        std::cout << ", " << result.cycles_ << " cycles\n " << std::hex;
+
+        for (int reg = 0; reg < R_COUNT; ++reg) {
+            std::cout << ' ' << names[reg] << "=0x" << std::setw(4) << result.regs_[reg];
+        }
+
+        std::cout << " pc=0x" << std::setw(4) << result.pc_ << " ram=" << std::setw(16) << result.ram_hash_ << '\n';
+
+        if (!vector.expected_registers_.empty() || !vector.expected_ram_.empty()) {
+            ++checked;
+            failed += !result.mismatches_.empty();
+
+            std::cout << "  " << (result.mismatches_.empty() ? "ok" : "FAIL");
+
+            for (const std::string& mismatch : result.mismatches_) {
+                std::cout << ' ' << mismatch;
+            }
+
+            std::cout << '\n';
+        }
+
+        ++reasons[result.reason_];
+        cycles += result.cycles_;
+        min_cycles = std::min(min_cycles, result.cycles_);
+        max_cycles = std::max(max_cycles, result.cycles_);
+
+        // instances ending with the same registers, pc and ram
+        std::vector<uint64_t> state { result.regs_.begin(), result.regs_.end() };
+        state.push_back(result.pc_);
+        state.push_back(result.ram_hash_);
+        states.insert(state);
+    }
+
+    std::cout << std::dec << std::setfill(' ');
+
+    std::cout << "\ninstances: " << report.instances_.size() << " on " << report.threads_ << " threads\n";
+    std::cout << "cycles: " << cycles << " in " << report.seconds_ * 1000 << " ms";
+
+    if (report.seconds_ > 0) {
+        std::cout << " (" << cycles / report.seconds_ / 1e6 << " MHz)";
+    }
+
+    std::cout << '\n';
+
+    if (report.instances_.empty()) {
+        return;
+    }
+
+    std::cout << "cycles per instance: " << min_cycles << " to " << max_cycles << '\n';
+    std::cout << "stopped:";
+
+    for (const auto& [reason, count] : reasons) {
+        std::cout << ' ' << halt_reason_name(reason) << ' ' << count << (reason == reasons.rbegin()->first ? "" : ",");
+    }
+
+    std::cout << '\n';
+
+    if (checked > 0) {
+        std::cout << "expected: " << checked - failed << " ok, " << failed << " failed\n";
+    }
+
+    std::cout << "distinct final states: " << states.size() << '\n';
+
+    if (report.lane_steps_ > 0) {
+        std::cout << "lockstep: " << std::fixed << std::setprecision(1) << 100.0 * report.lockstep_steps_ / report.lane_steps_
+                  << "% of " << report.lane_steps_ << " instructions" << std::defaultfloat << '\n';
+    }
+
+    if (report.splits_.empty()) {
+        return;
+    }
+
+    // the branches that split the most groups
+    std::vector<std::pair<uint32_t, uint64_t>> splits { report.splits_.begin(), report.splits_.end() };
+
+    std::stable_sort(splits.begin(), splits.end(), [](const auto& left, const auto& right) {
+        return left.second > right.second;
+    });
+
+    std::cout << "divergent branches:\n" << std::hex << std::uppercase << std::setfill('0');
+
+    for (size_t i = 0; i < splits.size() && i < 10; ++i) {
+        std::cout << "  0x" << std::setw(4) << splits[i].first << std::dec << "  " << splits[i].second << " splits\n" << std::hex;
+    }
+
+    std::cout << std::dec << std::setfill(' ');
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || std::string(argv[1]) == "-h") {
+        print_usage(argv[0]);
+        return argc < 2 ? 1 : 0;
+    }
+
+    std::vector<std::string> files;
+    OutputTypes type = HALF_DUAL_WORD;
+    bool type_set = false;
+    uint64_t max_cycles = 100000000;
+    size_t profile_top = 0;
+    std::string map_file;
+    std::string collapsed_file;
+    std::string vector_file;
+    size_t threads = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        if (arg == "-f" && i + 1 < argc) {
+            if (!parse_type(argv[++i], type)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+
+            type_set = true;
+        } else if (arg == "-c" && i + 1 < argc) {
+            if (!parse_count(argv[++i], max_cycles)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-p" && i + 1 < argc) {
+            if (!parse_count(argv[++i], profile_top)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-m" && i + 1 < argc) {
+            map_file = argv[++i];
+        } else if (arg == "--collapsed" && i + 1 < argc) {
+            collapsed_file = argv[++i];
+        } else if (arg == "--batch" && i + 1 < argc) {
+            vector_file = argv[++i];
+        } else if (arg == "-j" && i + 1 < argc) {
+            if (!parse_count(argv[++i], threads)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    std::string error;
+
+    if (!type_set && !detect_rom_type(files, type, error)) {
+        std::cout << error << '\n';
+        return 1;
+    }
+
+    std::vector<Word> rom;
+
+    if (!load_rom(files, type, rom, error)) {
+        std::cout << error << '\n';
+        return 1;
+    }
+
+    LineMap map;
+    SourceFile source;
+    const bool has_map = !map_file.empty();
+
+    if (has_map) {
+        if (!map.read(map_file)) {
+            std::cout << "Invalid line map: " << map_file << '\n';
+            return 1;
+        }
+
+        // the listing is optional, without it lines are reported by number only
+        if (!source.open(map.source_)) {
+            std::cout << "Source not found: " << map.source_ << '\n';
+        }
+    }
+
+    const bool profiling = profile_top > 0 || !collapsed_file.empty();
+
+    if (!vector_file.empty()) {
+        if (profiling) {
+            std::cout << "--batch can not be profiled" << '\n';
+            return 1;
+        }
+
+        std::vector<TestVector> vectors;
+
+        if (!read_vectors(vector_file, vectors, error)) {
+            std::cout << error << '\n';
+            return 1;
+        }
+
+        Emulator emulator;
+        emulator.load(rom);
+
+        const BatchReport report = BatchEmulator(emulator).run(vectors, max_cycles, threads);
+        print_batch(vectors, report);
+
+        const bool failed = std::any_of(report.instances_.begin(), report.instances_.end(), [](const InstanceResult& result) {
+            return result.reason_ == invalid_word || !result.mismatches_.empty();
+        });
+
+        return failed ? 1 : 0;
+    }
+
+    Emulator emulator;
+    Profile profile;
+    emulator.load(rom);
+
+    const auto start = std::chrono::steady_clock::now();
+    const HaltReasons reason = profiling ? emulator.run(max_cycles, profile) : emulator.run(max_cycles);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    print_state(emulator, elapsed.count());
+
+    if (profiling) {
+        Profiler profiler { profile, has_map ? &map : nullptr, source.line_count() > 0 ? &source : nullptr };
+
+        if (profile_top > 0) {
+            std::cout << '\n';
+            profiler.print(std::cout, profile_top);
+        }
+
+        if (!collapsed_file.empty() && !profiler.write_collapsed(collapsed_file)) {
+            std::cout << "Failed to open output file" << '\n';
+            return 1;
+        }
+    }
+
+    return reason == invalid_word ? 1 : 0;
+}
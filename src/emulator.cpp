@@ -0,0 +1,655 @@
+#include "emulator.hpp"
+
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+
+#if defined(__GNUC__)
+#define SPL_THREADED_DISPATCH 1
+#endif
+
+// register file index of a register putting its value on the bus, -1 if the code is not a register
+static int source_register(const uint16_t code) {
+    switch (code) {
+        case(A_TO_BUS):
+            return R_A;
+        case(B_TO_BUS):
+            return R_B;
+        case(C_TO_BUS):
+            return R_C;
+        case(ACC_TO_BUS):
+            return R_ACC;
+        case(FLGS_TO_BUS):
+            return R_FLGS;
+        case(LGC_TO_BUS):
+            return R_LGC;
+        default:
+            return -1;
+    }
+}
+
+// register file index of a register loading its value off the bus, -1 if the code is not a register
+static int dest_register(const uint16_t code) {
+    switch (code) {
+        case(A_FROM_BUS):
+            return R_A;
+        case(B_FROM_BUS):
+            return R_B;
+        case(C_FROM_BUS):
+            return R_C;
+        case(BUS_NUMBR):
+            return R_NUMBR;
+        case(BUS_MAR):
+            return R_MAR;
+        default:
+            return -1;
+    }
+}
+
+static inline void set_status(uint16_t* regs, const AluResult& result) {
+    regs[R_ACC] = result.acc_;
+    regs[R_FLGS] = result.flgs_;
+    regs[R_LGC] = result.lgc_;
+}
+
+static inline void alu_add(uint16_t* regs, const uint16_t value) {
+    set_status(regs, alu_result(ALU_ADD, regs[R_NUMBR], value));
+}
+
+static inline void alu_sub(uint16_t* regs, const uint16_t value) {
+    set_status(regs, alu_result(ALU_SUB, regs[R_NUMBR], value));
+}
+
+const char* halt_reason_name(HaltReasons reason) {
+    switch (reason) {
+        case(running):
+            return "running";
+        case(halted):
+            return "halted";
+        case(end_of_rom):
+            return "end of rom";
+        case(cycle_limit):
+            return "cycle limit";
+        case(invalid_word):
+            return "invalid word";
+        default:
+            return "unknown";
+    }
+}
+
+DecodedOp Emulator::decode(const Word word, const Word next) {
+    DecodedOp op;
+
+    const uint16_t alu = word_alu(word);
+    const uint16_t dest = word_dest(word);
+    const uint16_t src = word_src(word);
+    const uint16_t flags = word_flags(word);
+
+    const bool imm = flags == FLAG_IMM;
+    const int src_reg = source_register(src);
+    const int dest_reg = dest_register(dest);
+
+    op.word_ = word;
+    op.length_ = imm ? 2 : 1;
+    op.imm_ = imm ? next : 0;
+    op.src_ = src_reg < 0 ? 0 : src_reg;
+    op.dest_ = dest_reg < 0 ? 0 : dest_reg;
+    op.handler_ = OP_GENERIC;
+
+    // an immediate is only latched when nothing else drives the bus
+    const bool reg_source = !imm && flags == FLAG_NONE && src_reg >= 0;
+    const bool imm_source = imm && src == BUS_NONE;
+
+    if (word == make_word(ALU_NONE, BUS_NONE, BUS_HLT, FLAG_NONE)) {
+        op.handler_ = OP_HLT;
+    } else if (word == make_word(ALU_NONE, BUS_NONE, BUS_NONE, FLAG_NONE)) {
+        op.handler_ = OP_NOP;
+    } else if (word == make_word(ALU_NONE, BUS_RAM, BUS_RAM, FLAG_NONE)) {
+        op.handler_ = OP_EXEC;
+    } else if (alu == ALU_NONE && dest_reg >= 0) {
+        if (reg_source) {
+            op.handler_ = OP_MOV_R;
+        } else if (imm_source) {
+            op.handler_ = OP_MOV_I;
+        } else if (flags == FLAG_NONE && src == BUS_RAM) {
+            op.handler_ = OP_MOV_M;
+        }
+    } else if (alu == ALU_NONE && (dest == BUS_PC || dest == BUS_JE || dest == BUS_JNE)) {
+        static const uint8_t reg_ops[] = { OP_JMP_R, OP_JE_R, OP_JNE_R };
+        static const uint8_t imm_ops[] = { OP_JMP_I, OP_JE_I, OP_JNE_I };
+        const int kind = dest == BUS_PC ? 0 : (dest == BUS_JE ? 1 : 2);
+
+        if (reg_source) {
+            op.handler_ = reg_ops[kind];
+        } else if (imm_source) {
+            op.handler_ = imm_ops[kind];
+        }
+    } else if ((alu == ALU_ADD || alu == ALU_SUB || alu == ALU_CMP) && dest == BUS_NONE) {
+        const int kind = alu - ALU_ADD;
+        static const uint8_t reg_ops[] = { OP_ADD_R, OP_SUB_R, OP_CMP_R };
+        static const uint8_t imm_ops[] = { OP_ADD_I, OP_SUB_I, OP_CMP_I };
+
+        if (reg_source) {
+            op.handler_ = reg_ops[kind];
+        } else if (imm_source) {
+            op.handler_ = imm_ops[kind];
+        }
+    } else if (alu == ALU_RAM_WR && dest == BUS_WR && flags == FLAG_WR && src_reg >= 0) {
+        op.handler_ = OP_WR_R;
+    }
+
+    return op;
+}
+
+bool Emulator::execute_word(uint16_t* regs, uint16_t* ram, const size_t stride, const uint32_t rom_size, const Word word, const Word imm, uint32_t& next_pc, HaltReasons& reason) {
+    const uint16_t alu = word_alu(word);
+    const uint16_t dest = word_dest(word);
+    const uint16_t src = word_src(word);
+    const uint16_t flags = word_flags(word);
+
+    uint16_t value = 0;
+
+    if (src == BUS_HLT) {
+        reason = halted;
+        return true;
+    }
+
+    if (flags == FLAG_IMM) {
+        regs[R_CBUS_CACHE] = imm;
+        value = imm;
+    } else if (src == BUS_RAM) {
+        value = ram[regs[R_MAR] * stride];
+    } else if (src != BUS_NONE) {
+        const int reg = source_register(src);
+
+        if (reg < 0) {
+            return false;
+        }
+
+        value = regs[reg];
+    }
+
+    switch (alu) {
+        case(ALU_NONE):
+            break;
+        case(ALU_ADD):
+            alu_add(regs, value);
+            return dest == BUS_NONE;
+        case(ALU_SUB):
+        case(ALU_CMP):
+            alu_sub(regs, value);
+            return dest == BUS_NONE;
+        case(ALU_RAM_WR):
+            ram[regs[R_MAR] * stride] = value;
+            return true;
+        default:
+            return false;
+    }
+
+    const uint32_t target = value < rom_size ? value : rom_size;
+
+    switch (dest) {
+        case(BUS_NONE):
+            return true;
+        case(BUS_PC):
+            next_pc = target;
+            return true;
+        case(BUS_JE):
+            if (regs[R_LGC] & LGC_EQUAL) {
+                next_pc = target;
+            }
+            return true;
+        case(BUS_JNE):
+            if (!(regs[R_LGC] & LGC_EQUAL)) {
+                next_pc = target;
+            }
+            return true;
+        default:
+            break;
+    }
+
+    const int reg = dest_register(dest);
+
+    if (reg < 0) {
+        return false;
+    }
+
+    regs[reg] = value;
+
+    return true;
+}
+
+void Emulator::load(const std::vector<Word>& rom) {
+    rom_ = rom;
+
+    if (rom_.size() > ROM_WORDS) {
+        rom_.resize(ROM_WORDS);
+    }
+
+    // two end markers so an immediate instruction in the last word can step past the end
+    decoded_.assign(rom_.size() + 2, DecodedOp());
+
+    for (size_t pc = 0; pc < rom_.size(); ++pc) {
+        const Word next = pc + 1 < rom_.size() ? rom_[pc + 1] : 0;
+        decoded_[pc] = decode(rom_[pc], next);
+    }
+
+    reset();
+}
+
+void Emulator::reset() {
+    state_ = CpuState();
+}
+
+HaltReasons Emulator::run(uint64_t max_cycles) {
+    return run_loop<false>(max_cycles, nullptr);
+}
+
+HaltReasons Emulator::run(uint64_t max_cycles, Profile& profile) {
+    profile.counters_.resize(decoded_.size());
+
+    return run_loop<true>(max_cycles, &profile);
+}
+
+template <bool Profiling>
+HaltReasons Emulator::run_loop(uint64_t max_cycles, Profile* profile) {
+    CpuState& state = state_;
+
+    if (state.reason_ == cycle_limit) {
+        state.reason_ = running;
+    }
+
+    if (state.reason_ != running) {
+        return state.reason_;
+    }
+
+    const DecodedOp* ops = decoded_.data();
+    const uint32_t end = static_cast<uint32_t>(rom_.size());
+
+    uint16_t* regs = state.regs_.data();
+    uint16_t* ram = state.ram_.data();
+
+    uint32_t pc = state.pc_ < end ? state.pc_ : end;
+    uint64_t cycles = state.cycles_;
+    HaltReasons reason = running;
+
+    const DecodedOp* op;
+
+    // cycles are charged to an address when the next one is dispatched, end + 1 marks nothing run yet
+    ProfileCounter* counters = Profiling ? profile->counters_.data() : nullptr;
+    uint32_t prev_pc = end + 1;
+    uint64_t prev_cycles = cycles;
+
+#define PROFILE() \
+    if constexpr (Profiling) { \
+        counters[prev_pc].cycles_ += cycles - prev_cycles; \
+        ++counters[pc].hits_; \
+        if (pc <= prev_pc && prev_pc < end) { \
+            ++profile->back_edges_[static_cast<uint64_t>(prev_pc) << 32 | pc]; \
+        } \
+        prev_pc = pc; \
+        prev_cycles = cycles; \
+    }
+
+#define CLAMP(target) ((target) < end ? (target) : end)
+
+#ifdef SPL_THREADED_DISPATCH
+    static const void* labels[OP_COUNT] = {
+        &&L_OP_NOP, &&L_OP_MOV_R, &&L_OP_MOV_I, &&L_OP_MOV_M,
+        &&L_OP_ADD_R, &&L_OP_ADD_I, &&L_OP_SUB_R, &&L_OP_SUB_I, &&L_OP_CMP_R, &&L_OP_CMP_I,
+        &&L_OP_JMP_R, &&L_OP_JMP_I, &&L_OP_JE_R, &&L_OP_JE_I, &&L_OP_JNE_R, &&L_OP_JNE_I,
+        &&L_OP_WR_R, &&L_OP_EXEC, &&L_OP_HLT, &&L_OP_GENERIC, &&L_OP_END
+    };
+
+#define HANDLER(name) L_##name:
+#define NEXT() \
+    op = &ops[pc]; \
+    if (cycles >= max_cycles) goto limit; \
+    PROFILE() \
+    goto *labels[op->handler_]
+
+    NEXT();
+#else
+#define HANDLER(name) case(name):
+#define NEXT() continue
+
+    for (;;) {
+        op = &ops[pc];
+
+        if (cycles >= max_cycles) {
+            goto limit;
+        }
+
+        PROFILE()
+
+        switch (op->handler_) {
+#endif
+
+    HANDLER(OP_NOP) {
+        cycles += 1;
+        pc += 1;
+        NEXT();
+    }
+    HANDLER(OP_MOV_R) {
+        regs[op->dest_] = regs[op->src_];
+        cycles += 1;
+        pc += 1;
+        NEXT();
+    }
+    HANDLER(OP_MOV_I) {
+        regs[R_CBUS_CACHE] = op->imm_;
+        regs[op->dest_] = op->imm_;
+        cycles += 2;
+        pc += 2;
+        NEXT();
+    }
+    HANDLER(OP_MOV_M) {
+        regs[op->dest_] = ram[regs[R_MAR]];
+        cycles += 1;
+        pc += 1;
+        NEXT();
+    }
+    HANDLER(OP_ADD_R) {
+        alu_add(regs, regs[op->src_]);
+        cycles += 1;
+        pc += 1;
+        NEXT();
+    }
+    HANDLER(OP_ADD_I) {
+        regs[R_CBUS_CACHE] = op->imm_;
+        alu_add(regs, op->imm_);
+        cycles += 2;
+        pc += 2;
+        NEXT();
+    }
+    HANDLER(OP_SUB_R)
+    HANDLER(OP_CMP_R) {
+        alu_sub(regs, regs[op->src_]);
+        cycles += 1;
+        pc += 1;
+        NEXT();
+    }
+    HANDLER(OP_SUB_I)
+    HANDLER(OP_CMP_I) {
+        regs[R_CBUS_CACHE] = op->imm_;
+        alu_sub(regs, op->imm_);
+        cycles += 2;
+        pc += 2;
+        NEXT();
+    }
+    HANDLER(OP_JMP_R) {
+        pc = CLAMP(regs[op->src_]);
+        cycles += 1;
+        NEXT();
+    }
+    HANDLER(OP_JMP_I) {
+        regs[R_CBUS_CACHE] = op->imm_;
+        pc = CLAMP(op->imm_);
+        cycles += 2;
+        NEXT();
+    }
+    HANDLER(OP_JE_R) {
+        pc = (regs[R_LGC] & LGC_EQUAL) ? CLAMP(regs[op->src_]) : pc + 1;
+        cycles += 1;
+        NEXT();
+    }
+    HANDLER(OP_JE_I) {
+        regs[R_CBUS_CACHE] = op->imm_;
+        pc = (regs[R_LGC] & LGC_EQUAL) ? CLAMP(op->imm_) : pc + 2;
+        cycles += 2;
+        NEXT();
+    }
+    HANDLER(OP_JNE_R) {
+        pc = (regs[R_LGC] & LGC_EQUAL) ? pc + 1 : CLAMP(regs[op->src_]);
+        cycles += 1;
+        NEXT();
+    }
+    HANDLER(OP_JNE_I) {
+        regs[R_CBUS_CACHE] = op->imm_;
+        pc = (regs[R_LGC] & LGC_EQUAL) ? pc + 2 : CLAMP(op->imm_);
+        cycles += 2;
+        NEXT();
+    }
+    HANDLER(OP_WR_R) {
+        ram[regs[R_MAR]] = regs[op->src_];
+        cycles += 1;
+        pc += 1;
+        NEXT();
+    }
+    HANDLER(OP_EXEC) {
+        // the word at mar is fetched from ram and run in place of the next rom word
+        const uint16_t mar = regs[R_MAR];
+        const Word word = ram[mar];
+        const Word imm = ram[static_cast<uint16_t>(mar + 1)];
+        uint32_t next_pc = pc + 1;
+
+        cycles += word_flags(word) == FLAG_IMM ? 3 : 2;
+
+        if (word == make_word(ALU_NONE, BUS_RAM, BUS_RAM, FLAG_NONE) || !execute_word(regs, ram, 1, end, word, imm, next_pc, state.reason_)) {
+            state.bad_word_ = word;
+            reason = invalid_word;
+            goto done;
+        }
+
+        pc = CLAMP(next_pc);
+
+        if (state.reason_ != running) {
+            reason = state.reason_;
+            goto done;
+        }
+
+        NEXT();
+    }
+    HANDLER(OP_HLT) {
+        cycles += 1;
+        pc += 1;
+        reason = halted;
+        goto done;
+    }
+    HANDLER(OP_GENERIC) {
+        uint32_t next_pc = pc + op->length_;
+
+        if (!execute_word(regs, ram, 1, end, op->word_, op->imm_, next_pc, state.reason_)) {
+            state.bad_word_ = op->word_;
+            reason = invalid_word;
+            goto done;
+        }
+
+        cycles += op->length_;
+        pc = CLAMP(next_pc);
+
+        if (state.reason_ != running) {
+            reason = state.reason_;
+            goto done;
+        }
+
+        NEXT();
+    }
+    HANDLER(OP_END) {
+        pc = end;
+        reason = end_of_rom;
+        goto done;
+    }
+
+#ifndef SPL_THREADED_DISPATCH
+            default:
+                goto done;
+        }
+    }
+#endif
+
+#undef HANDLER
+#undef NEXT
+#undef CLAMP
+#undef PROFILE
+
+limit:
+    reason = cycle_limit;
+
+done:
+    if constexpr (Profiling) {
+        counters[prev_pc].cycles_ += cycles - prev_cycles;
+    }
+
+    state.pc_ = pc;
+    state.cycles_ = cycles;
+    state.reason_ = reason;
+
+    return reason;
+}
+
+static bool read_values(const std::string& file_name, std::vector<std::string>& values, std::string& error) {
+    std::ifstream file { file_name };
+
+    if (!file.is_open()) {
+        error = "File not found: " + file_name;
+        return false;
+    }
+
+    std::string line;
+
+    if (!std::getline(file, line) || line.compare(0, 8, "v2.0 raw") != 0) {
+        error = "Not a v2.0 raw image: " + file_name;
+        return false;
+    }
+
+    while (std::getline(file, line)) {
+        // everything after # is a comment
+        std::stringstream stream { line.substr(0, line.find('#')) };
+        std::string value;
+
+        while (stream >> value) {
+            // n*value repeats the value n times
+            const size_t star = value.find('*');
+
+            if (star != std::string::npos) {
+                const char* end = value.data() + star;
+                size_t count = 0;
+                const auto [last, result] = std::from_chars(value.data(), end, count);
+
+                // a D8 image holds two values per rom word, so no image needs more than that
+                if (result != std::errc() || last != end || star == 0 || count > 2 * ROM_WORDS || values.size() + count > 2 * ROM_WORDS) {
+                    error = "Invalid repeat in image: " + value;
+                    return false;
+                }
+
+                values.insert(values.end(), count, value.substr(star + 1));
+            } else {
+                values.push_back(value);
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool parse_value(const std::string& value, const size_t width, uint16_t& out) {
+    if (value.empty() || value.size() > width) {
+        return false;
+    }
+
+    for (const char digit : value) {
+        if (!isxdigit(static_cast<unsigned char>(digit))) {
+            return false;
+        }
+    }
+
+    out = static_cast<uint16_t>(std::stoul(value, nullptr, 16));
+
+    return true;
+}
+
+bool detect_rom_type(const std::vector<std::string>& files, OutputTypes& type, std::string& error) {
+    if (files.size() == 2) {
+        type = HALF_SINGLE_WORD;
+        return true;
+    }
+
+    if (files.size() != 1) {
+        error = "Expected one image, or a high and low image";
+        return false;
+    }
+
+    std::vector<std::string> values;
+
+    if (!read_values(files[0], values, error)) {
+        return false;
+    }
+
+    type = (!values.empty() && values[0].size() > 2) ? FULL_SINGLE_WORD : HALF_DUAL_WORD;
+
+    return true;
+}
+
+bool load_rom(const std::vector<std::string>& files, OutputTypes type, std::vector<Word>& rom, std::string& error) {
+    rom.clear();
+
+    const size_t expected = type == HALF_SINGLE_WORD ? 2 : 1;
+
+    if (files.size() != expected) {
+        error = type == HALF_SINGLE_WORD ? "S8 images need a high and a low file" : "Expected a single image file";
+        return false;
+    }
+
+    std::vector<std::string> first;
+
+    if (!read_values(files[0], first, error)) {
+        return false;
+    }
+
+    if (type == FULL_SINGLE_WORD) {
+        for (const auto& value : first) {
+            uint16_t word;
+
+            if (!parse_value(value, 4, word)) {
+                error = "Invalid value in image: " + value;
+                return false;
+            }
+
+            rom.push_back(word);
+        }
+
+        return true;
+    }
+
+    std::vector<std::string> high;
+    std::vector<std::string> low;
+
+    if (type == HALF_SINGLE_WORD) {
+        high = first;
+
+        if (!read_values(files[1], low, error)) {
+            return false;
+        }
+
+        if (high.size() != low.size()) {
+            error = "High and low images have different lengths";
+            return false;
+        }
+    } else {
+        if (first.size() % 2 != 0) {
+            error = "D8 image has an odd number of bytes";
+            return false;
+        }
+
+        for (size_t i = 0; i < first.size(); i += 2) {
+            high.push_back(first[i]);
+            low.push_back(first[i + 1]);
+        }
+    }
+
+    for (size_t i = 0; i < high.size(); ++i) {
+        uint16_t high_byte;
+        uint16_t low_byte;
+
+        if (!parse_value(high[i], 2, high_byte) || !parse_value(low[i], 2, low_byte)) {
+            error = "Invalid byte in image: " + high[i] + " " + low[i];
+            return false;
+        }
+
+        rom.push_back(static_cast<Word>(high_byte << 8 | low_byte));
+    }
+
+    return true;
+}
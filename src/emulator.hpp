@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "isa.hpp"
+
+constexpr size_t RAM_WORDS = 1 << 16;
+constexpr size_t ROM_WORDS = 1 << 16;
+
+// index of each register in the emulator register file
+enum EmuRegisters : uint8_t {
+    R_A,
+    R_B,
+    R_C,
+    R_ACC,
+    R_FLGS,
+    R_LGC,
+    R_NUMBR,
+    R_MAR,
+    R_CBUS_CACHE,
+    R_COUNT
+};
+
+enum HaltReasons {
+    running,
+    halted, // hlt was executed
+    end_of_rom, // pc moved past the last word of the program
+    cycle_limit,
+    invalid_word
+};
+
+// predecoded handler for a control word, the generic handler decodes the word at run time
+enum OpHandlers : uint8_t {
+    OP_NOP,
+    OP_MOV_R,
+    OP_MOV_I,
+    OP_MOV_M,
+    OP_ADD_R,
+    OP_ADD_I,
+    OP_SUB_R,
+    OP_SUB_I,
+    OP_CMP_R,
+    OP_CMP_I,
+    OP_JMP_R,
+    OP_JMP_I,
+    OP_JE_R,
+    OP_JE_I,
+    OP_JNE_R,
+    OP_JNE_I,
+    OP_WR_R,
+    OP_EXEC,
+    OP_HLT,
+    OP_GENERIC,
+    OP_END,
+    OP_COUNT
+};
+
+struct DecodedOp {
+    uint8_t handler_ = OP_END;
+    uint8_t dest_ = 0; // EmuRegisters index
+    uint8_t src_ = 0; // EmuRegisters index
+    uint8_t length_ = 1; // words consumed, 2 when an immediate follows
+    uint16_t imm_ = 0;
+    Word word_ = 0;
+};
+
+struct ProfileCounter {
+    uint64_t hits_ = 0;
+    uint64_t cycles_ = 0;
+};
+
+struct Profile {
+    // one counter per rom address
+    std::vector<ProfileCounter> counters_;
+
+    // times control moved from an address back to an earlier (or the same) one, keyed by from << 32 | to
+    std::unordered_map<uint64_t, uint64_t> back_edges_;
+};
+
+struct CpuState {
+    std::array<uint16_t, R_COUNT> regs_ {};
+    uint32_t pc_ = 0;
+    uint64_t cycles_ = 0;
+    std::vector<uint16_t> ram_ = std::vector<uint16_t>(RAM_WORDS, 0);
+    HaltReasons reason_ = running;
+    Word bad_word_ = 0;
+};
+
+// reads a v2.0 raw image (or the high/low pair for HALF_SINGLE_WORD) back into control words
+bool load_rom(const std::vector<std::string>& files, OutputTypes type, std::vector<Word>& rom, std::string& error);
+
+// guesses the layout from the number of files and the width of the first value
+bool detect_rom_type(const std::vector<std::string>& files, OutputTypes& type, std::string& error);
+
+const char* halt_reason_name(HaltReasons reason);
+
+/*
+ * Executes control words the way the cpu does: every word fetched from rom (or ram for exec)
+ * takes one clock cycle, so an instruction with an immediate costs two. The program is
+ * predecoded once into handlers and run with a threaded dispatch loop.
+ */
+class Emulator {
+    private:
+        std::vector<Word> rom_;
+        std::vector<DecodedOp> decoded_;
+        CpuState state_;
+
+        static DecodedOp decode(const Word word, const Word next);
+
+        template <bool Profiling>
+        HaltReasons run_loop(uint64_t max_cycles, Profile* profile);
+
+    public:
+        Emulator() = default;
+
+        /*
+         * Slow path used for exec and words without a predecoded handler, returns false on an
+         * invalid word. Ram words are stride apart, so the state of several cpus can be kept
+         * interleaved. reason is set to halted by a hlt.
+         */
+        static bool execute_word(uint16_t* regs, uint16_t* ram, size_t stride, uint32_t rom_size, const Word word, const Word imm, uint32_t& next_pc, HaltReasons& reason);
+
+        void load(const std::vector<Word>& rom);
+        void reset();
+
+        HaltReasons run(uint64_t max_cycles);
+
+        // same as run but counts hits and cycles for every rom address
+        HaltReasons run(uint64_t max_cycles, Profile& profile);
+
+        const CpuState& state() const {
+            return state_;
+        }
+
+        CpuState& state() {
+            return state_;
+        }
+
+        const std::vector<Word>& rom() const {
+            return rom_;
+        }
+
+        // one handler per rom address, followed by two OP_END
+        const std::vector<DecodedOp>& decoded() const {
+            return decoded_;
+        }
+
+        ~Emulator() = default;
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "isa.hpp"
+#include "lexer.hpp"
+
+enum Types {
+    REG,
+    IMM,
+    REG_IMM,
+    NONE
+};
+
+// order matches instruction_table and encodings
+enum Instructions {
+    MOV,
+    WR,
+    RD,
+    EXEC,
+    ADD,
+    SUB,
+    JMP,
+    CMP,
+    JE,
+    JNE,
+    HLT
+};
+
+struct RegisterCode {
+    std::string_view name_;
+    uint16_t from_bus_;
+    uint16_t to_bus_;
+};
+
+constexpr RegisterCode register_codes[] = {
+    { "a", A_FROM_BUS, A_TO_BUS },
+    { "b", B_FROM_BUS, B_TO_BUS },
+    { "c", C_FROM_BUS, C_TO_BUS },
+    { "acc", N_ALWD, ACC_TO_BUS },
+    { "flgs", N_ALWD, FLGS_TO_BUS },
+    { "lgc", N_ALWD, LGC_TO_BUS },
+};
+
+// index into register_codes, -1 when the name is not a register
+constexpr int find_register(const std::string_view name) {
+    if (name.empty()) {
+        return -1;
+    }
+
+    switch (name[0]) {
+        case('a'):
+            return name == "a" ? 0 : (name == "acc" ? 3 : -1);
+        case('b'):
+            return name == "b" ? 1 : -1;
+        case('c'):
+            return name == "c" ? 2 : -1;
+        case('f'):
+            return name == "flgs" ? 4 : -1;
+        case('l'):
+            return name == "lgc" ? 5 : -1;
+        default:
+            return -1;
+    }
+}
+
+struct InstructionInfo {
+    std::string_view name_;
+    Instructions type_;
+
+    int children_;
+    Types child_types_[MAX_OPERANDS];
+};
+
+constexpr InstructionInfo instruction_table[] = {
+    { "mov", MOV, 2, { REG, REG_IMM } },
+    { "wr", WR, 2, { REG_IMM, REG } },
+    { "rd", RD, 2, { REG_IMM, REG } },
+    { "exec", EXEC, 1, { REG_IMM, NONE } },
+    { "add", ADD, 2, { REG_IMM, REG_IMM } },
+    { "sub", SUB, 2, { REG_IMM, REG_IMM } },
+    { "jmp", JMP, 1, { REG_IMM, NONE } },
+    { "cmp", CMP, 2, { REG_IMM, REG_IMM } },
+    { "je", JE, 1, { REG_IMM, NONE } },
+    { "jne", JNE, 1, { REG_IMM, NONE } },
+    { "hlt", HLT, 0, { NONE, NONE } },
+};
+
+// nullptr when the mnemonic is not an instruction
+constexpr const InstructionInfo* find_instruction(const std::string_view name) {
+    if (name.empty()) {
+        return nullptr;
+    }
+
+    Instructions inst;
+
+    switch (name[0]) {
+        case('m'):
+            inst = MOV;
+            break;
+        case('w'):
+            inst = WR;
+            break;
+        case('r'):
+            inst = RD;
+            break;
+        case('e'):
+            inst = EXEC;
+            break;
+        case('a'):
+            inst = ADD;
+            break;
+        case('s'):
+            inst = SUB;
+            break;
+        case('c'):
+            inst = CMP;
+            break;
+        case('h'):
+            inst = HLT;
+            break;
+        case('j'):
+            inst = name.size() == 2 ? JE : (name.size() > 1 && name[1] == 'm' ? JMP : JNE);
+            break;
+        default:
+            return nullptr;
+    }
+
+    return instruction_table[inst].name_ == name ? &instruction_table[inst] : nullptr;
+}
+
+// parsed operand, value_ is an index into register_codes for REG and the word itself for IMM
+struct Operand {
+    Types type_ = NONE;
+    uint16_t value_ = 0;
+};
+
+constexpr int8_t NO_OPERAND = -1;
+
+// one control word of an encoding, optionally followed by an immediate operand
+struct EncodingStep {
+    uint16_t alu_;
+
+    // fixed destination, or the register operand whose from bus code is the destination
+    uint16_t dest_;
+    int8_t dest_operand_;
+
+    // fixed source, or the operand put on the bus (a register, or an immediate in the next word)
+    uint16_t src_;
+    int8_t src_operand_;
+
+    uint16_t flags_;
+};
+
+struct Encoding {
+    uint8_t steps_count_;
+    EncodingStep steps_[2];
+};
+
+constexpr EncodingStep fixed_step(const uint16_t alu, const uint16_t dest, const uint16_t src) {
+    return { alu, dest, NO_OPERAND, src, NO_OPERAND, FLAG_NONE };
+}
+
+constexpr EncodingStep load_step(const uint16_t alu, const uint16_t dest, const int8_t operand) {
+    return { alu, dest, NO_OPERAND, BUS_NONE, operand, FLAG_NONE };
+}
+
+// indexed by Instructions
+constexpr Encoding encodings[] = {
+    // mov: register operand 0 loads operand 1
+    { 1, { { ALU_NONE, BUS_NONE, 0, BUS_NONE, 1, FLAG_NONE } } },
+    // wr: address into mar, register operand 1 written to ram
+    { 2, { load_step(ALU_NONE, BUS_MAR, 0), { ALU_RAM_WR, BUS_WR, NO_OPERAND, BUS_NONE, 1, FLAG_WR } } },
+    // rd: address into mar, ram into register operand 1
+    { 2, { load_step(ALU_NONE, BUS_MAR, 0), { ALU_NONE, BUS_NONE, 1, BUS_RAM, NO_OPERAND, FLAG_NONE } } },
+    // exec: address into mar, then run the word held in ram
+    { 2, { load_step(ALU_NONE, BUS_MAR, 0), fixed_step(ALU_NONE, BUS_RAM, BUS_RAM) } },
+    // add: first value into numbr, the second added to it
+    { 2, { load_step(ALU_NONE, BUS_NUMBR, 0), load_step(ALU_ADD, BUS_NONE, 1) } },
+    // sub: second value into numbr, the first is subtracted from it
+    { 2, { load_step(ALU_NONE, BUS_NUMBR, 1), load_step(ALU_SUB, BUS_NONE, 0) } },
+    // jmp
+    { 1, { load_step(ALU_NONE, BUS_PC, 0) } },
+    // cmp: same operand order as sub
+    { 2, { load_step(ALU_NONE, BUS_NUMBR, 1), load_step(ALU_CMP, BUS_NONE, 0) } },
+    // je
+    { 1, { load_step(ALU_NONE, BUS_JE, 0) } },
+    // jne
+    { 1, { load_step(ALU_NONE, BUS_JNE, 0) } },
+    // hlt
+    { 1, { fixed_step(ALU_NONE, BUS_NONE, BUS_HLT) } },
+};
+
+// appends the control words for the instruction to out
+inline void encode(const Instructions inst, const Operand* operands, std::vector<Word>& out) {
+    const Encoding& encoding = encodings[inst];
+
+    for (uint8_t i = 0; i < encoding.steps_count_; ++i) {
+        const EncodingStep& step = encoding.steps_[i];
+        const uint16_t dest = step.dest_operand_ == NO_OPERAND ? step.dest_ : register_codes[operands[step.dest_operand_].value_].from_bus_;
+
+        if (step.src_operand_ == NO_OPERAND) {
+            out.push_back(make_word(step.alu_, dest, step.src_, step.flags_));
+            continue;
+        }
+
+        const Operand& src = operands[step.src_operand_];
+
+        if (src.type_ == IMM) {
+            out.push_back(make_word(step.alu_, dest, BUS_NONE, FLAG_IMM));
+            out.push_back(src.value_);
+        } else {
+            out.push_back(make_word(step.alu_, dest, register_codes[src.value_].to_bus_, step.flags_));
+        }
+    }
+}
+
+// number of words encode emits for an instruction and its operand types
+constexpr uint32_t instruction_size(const Instructions inst, const Types first, const Types second) {
+    const Encoding& encoding = encodings[inst];
+    uint32_t size = encoding.steps_count_;
+
+    for (uint8_t i = 0; i < encoding.steps_count_; ++i) {
+        const int8_t operand = encoding.steps_[i].src_operand_;
+
+        if ((operand == 0 && first == IMM) || (operand == 1 && second == IMM)) {
+            ++size;
+        }
+    }
+
+    return size;
+}
+
+// word the immediate of an operand is encoded into, counted from the first word of the instruction, -1 when there is none
+constexpr int immediate_offset(const Instructions inst, const Types first, const Types second, const uint8_t operand) {
+    const Encoding& encoding = encodings[inst];
+    int offset = 0;
+
+    for (uint8_t i = 0; i < encoding.steps_count_; ++i) {
+        const int8_t src = encoding.steps_[i].src_operand_;
+        const bool immediate = (src == 0 && first == IMM) || (src == 1 && second == IMM);
+
+        if (immediate && src == operand) {
+            return offset + 1;
+        }
+
+        offset += immediate ? 2 : 1;
+    }
+
+    return -1;
+}
+
+static_assert(find_instruction("jne") == &instruction_table[JNE] && find_instruction("jn") == nullptr);
+static_assert(instruction_size(SUB, IMM, REG) == 3 && instruction_size(HLT, NONE, NONE) == 1);
+static_assert(immediate_offset(SUB, IMM, IMM, 0) == 3 && immediate_offset(JMP, REG, NONE, 0) == -1);
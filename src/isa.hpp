@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+
+enum OutputTypes {
+    HALF_DUAL_WORD, // EEPROM which outputs data at address n and n+1, 2 8 bit outputs
+    HALF_SINGLE_WORD, // EEPROM which outputs data at address n so 2 have to be used as data width is 8 bits
+    FULL_SINGLE_WORD // EEPROM which outputs data at address n but data width is 16 bits
+};
+
+// control word layout: [15:12] alu op, [11:7] bus destination, [6:2] bus source, [1:0] flags
+enum AluOps : uint16_t {
+    ALU_NONE = 0b0000,
+    ALU_ADD = 0b0001,
+    ALU_SUB = 0b0010,
+    ALU_CMP = 0b0011,
+    ALU_RAM_WR = 0b1000
+};
+
+enum BusCodes : uint16_t {
+    BUS_NONE = 0b00000,
+    BUS_WR = 0b00010,
+    BUS_NUMBR = 0b00100,
+    BUS_PC = 0b00110,
+    BUS_MAR = 0b00111,
+    BUS_RAM = 0b01001,
+    BUS_JNE = 0b11110,
+    BUS_JE = 0b11111,
+    BUS_HLT = 0b11111,
+    N_ALWD = 0xFFFF // register can not be written to from the bus
+};
+
+// register codes, FROM_BUS loads the register off the bus and TO_BUS puts it on the bus
+enum RegisterBusCodes : uint16_t {
+    A_FROM_BUS = 0b00001,
+    B_FROM_BUS = 0b00011,
+    C_FROM_BUS = 0b01000,
+
+    A_TO_BUS = 0b00001,
+    B_TO_BUS = 0b00010,
+    C_TO_BUS = 0b00111,
+    ACC_TO_BUS = 0b00100,
+    FLGS_TO_BUS = 0b00101,
+    LGC_TO_BUS = 0b01000
+};
+
+enum WordFlags : uint16_t {
+    FLAG_NONE = 0b00,
+    FLAG_IMM = 0b01, // next word is an immediate, latched through CBUS_CACHE
+    FLAG_WR = 0b11
+};
+
+// bits set in FLGS by add/sub and in LGC by cmp
+enum StatusBits : uint16_t {
+    FLGS_ZERO = 1 << 0,
+    FLGS_CARRY = 1 << 1,
+    FLGS_NEGATIVE = 1 << 2,
+
+    LGC_EQUAL = 1 << 0,
+    LGC_LESS = 1 << 1,
+    LGC_GREATER = 1 << 2
+};
+
+using Word = uint16_t;
+
+constexpr Word make_word(uint16_t alu, uint16_t dest, uint16_t src, uint16_t flags) {
+    return static_cast<Word>((alu << 12) | (dest << 7) | (src << 2) | flags);
+}
+
+constexpr uint16_t word_alu(Word word) {
+    return word >> 12;
+}
+
+constexpr uint16_t word_dest(Word word) {
+    return (word >> 7) & 0b11111;
+}
+
+constexpr uint16_t word_src(Word word) {
+    return (word >> 2) & 0b11111;
+}
+
+constexpr uint16_t word_flags(Word word) {
+    return word & 0b11;
+}
+
+struct AluResult {
+    uint16_t acc_;
+    uint16_t flgs_;
+    uint16_t lgc_;
+};
+
+// acc, flgs and lgc after an alu operation, sub and cmp both take the bus value away from numbr
+constexpr AluResult alu_result(const uint16_t alu, const uint16_t numbr, const uint16_t value) {
+    const uint32_t result = alu == ALU_ADD ? static_cast<uint32_t>(numbr) + value : static_cast<uint32_t>(numbr) - value;
+    const bool carry = alu == ALU_ADD ? result > 0xFFFF : value > numbr;
+    const uint16_t acc = static_cast<uint16_t>(result);
+
+    return {
+        acc,
+        static_cast<uint16_t>((acc == 0 ? FLGS_ZERO : 0) | (carry ? FLGS_CARRY : 0) | (acc & 0x8000 ? FLGS_NEGATIVE : 0)),
+        static_cast<uint16_t>(value == numbr ? LGC_EQUAL : (value < numbr ? LGC_LESS : LGC_GREATER))
+    };
+}
@@ -0,0 +1,107 @@
+#include "lexer.hpp"
+
+std::string_view Lexer::trim(std::string_view text) {
+    size_t start = 0;
+    size_t end = text.size();
+
+    while (start < end && is_space(text[start])) {
+        ++start;
+    }
+
+    while (end > start && is_space(text[end - 1])) {
+        --end;
+    }
+
+    return text.substr(start, end - start);
+}
+
+bool Lexer::next(LexToken& token) {
+    const size_t size = source_.size();
+
+    while (pos_ < size) {
+        const size_t line_start = pos_;
+        const uint32_t line = line_;
+
+        // skip leading whitespace
+        while (pos_ < size && is_space(source_[pos_])) {
+            ++pos_;
+        }
+
+        // blank line
+        if (pos_ == size || source_[pos_] == '\n') {
+            ++pos_;
+            ++line_;
+            continue;
+        }
+
+        token.line_ = line;
+        token.column_ = static_cast<uint32_t>(pos_ - line_start + 1);
+        token.operand_count_ = 0;
+        token.operands_.fill(std::string_view());
+        token.label_ = std::string_view();
+
+        // mnemonic runs until whitespace, a comma, a colon or the end of the line
+        size_t mnemonic_start = pos_;
+
+        while (pos_ < size && !is_space(source_[pos_]) && source_[pos_] != ',' && source_[pos_] != ':' && source_[pos_] != '\n') {
+            ++pos_;
+        }
+
+        // a colon makes it a label, which can be followed by an instruction on the same line
+        if (pos_ < size && source_[pos_] == ':') {
+            token.label_ = source_.substr(mnemonic_start, pos_ - mnemonic_start);
+            ++pos_;
+
+            while (pos_ < size && is_space(source_[pos_])) {
+                ++pos_;
+            }
+
+            mnemonic_start = pos_;
+
+            while (pos_ < size && !is_space(source_[pos_]) && source_[pos_] != ',' && source_[pos_] != '\n') {
+                ++pos_;
+            }
+        }
+
+        token.mnemonic_ = source_.substr(mnemonic_start, pos_ - mnemonic_start);
+
+        // operands are separated by commas, surrounding whitespace is ignored
+        size_t operand_start = pos_;
+        const size_t rest_start = pos_;
+
+        while (true) {
+            const bool at_end = pos_ == size || source_[pos_] == '\n';
+
+            if (at_end || source_[pos_] == ',') {
+                std::string_view operand = trim(source_.substr(operand_start, pos_ - operand_start));
+
+                // a trailing comma does not start a new operand
+                if (!operand.empty() || !at_end) {
+                    if (token.operand_count_ < MAX_OPERANDS) {
+                        token.operands_[token.operand_count_] = operand;
+                    }
+
+                    ++token.operand_count_;
+                }
+
+                if (at_end) {
+                    token.rest_ = trim(source_.substr(rest_start, pos_ - rest_start));
+                    break;
+                }
+
+                operand_start = pos_ + 1;
+            }
+
+            ++pos_;
+        }
+
+        if (pos_ < size) {
+            ++pos_;
+            ++line_;
+        }
+
+        return true;
+    }
+
+    return false;
+}
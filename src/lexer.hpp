@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+constexpr size_t MAX_OPERANDS = 2;
+
+// one source line split into views of the loaded buffer, nothing is copied
+struct LexToken {
+    // "name:" at the start of the line, the mnemonic is empty when the label is alone on its line
+    std::string_view label_;
+    std::string_view mnemonic_;
+    std::array<std::string_view, MAX_OPERANDS> operands_;
+
+    // number of operands found on the line, can be larger than MAX_OPERANDS
+    size_t operand_count_ = 0;
+
+    // everything after the mnemonic, for directives and macros that take more than MAX_OPERANDS
+    std::string_view rest_;
+
+    uint32_t line_ = 0;
+    uint32_t column_ = 0;
+};
+
+class Lexer {
+    private:
+        std::string_view source_;
+        size_t pos_ = 0;
+        uint32_t line_ = 1;
+
+        static bool is_space(const char c) {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+    public:
+        // text without the spaces, tabs and carriage returns around it
+        static std::string_view trim(std::string_view text);
+
+        Lexer() = delete;
+
+        // first_line numbers the lines of a source that continues an earlier one
+        explicit Lexer(std::string_view source, uint32_t first_line = 1) : source_(source), line_(first_line) {};
+
+        // fills token with the next non blank line, returns false at the end of the source
+        bool next(LexToken& token);
+
+        ~Lexer() = default;
+};
@@ -0,0 +1,104 @@
+#include "linemap.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+
+/*
+ * map files are plain text:
+ *   spl-map v1
+ *   source <path>
+ *   <hex address> <words> <line>
+ */
+
+const LineMapEntry* LineMap::find(uint32_t address) const {
+    auto it = std::upper_bound(entries_.begin(), entries_.end(), address, [](uint32_t value, const LineMapEntry& entry) {
+        return value < entry.address_;
+    });
+
+    if (it == entries_.begin()) {
+        return nullptr;
+    }
+
+    --it;
+
+    if (address >= it->address_ + it->words_) {
+        return nullptr;
+    }
+
+    return &*it;
+}
+
+bool LineMap::write(const std::string& file_name) const {
+    std::ofstream file { file_name };
+
+    if (!file.is_open()) {
+        return false;
+    }
+
+    write(file);
+
+    return file.good();
+}
+
+void LineMap::write(std::ostream& out) const {
+    write_header(out, source_);
+
+    for (const LineMapEntry& entry : entries_) {
+        write_entry(out, entry);
+    }
+}
+
+void LineMap::write_header(std::ostream& out, const std::string& source) {
+    out << "spl-map v1\n";
+    out << "source " << source << '\n';
+}
+
+void LineMap::write_entry(std::ostream& out, const LineMapEntry& entry) {
+    out << "0x" << std::hex << entry.address_ << std::dec << ' ' << entry.words_ << ' ' << entry.line_ << '\n';
+}
+
+bool LineMap::read(const std::string& file_name) {
+    std::ifstream file { file_name };
+
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::string line;
+
+    if (!std::getline(file, line) || line != "spl-map v1") {
+        return false;
+    }
+
+    if (!std::getline(file, line) || line.compare(0, 7, "source ") != 0) {
+        return false;
+    }
+
+    source_ = line.substr(7);
+    entries_.clear();
+
+    while (std::getline(file, line)) {
+        std::stringstream stream { line };
+        std::string address;
+        LineMapEntry entry;
+
+        if (!(stream >> address >> entry.words_ >> entry.line_)) {
+            return false;
+        }
+
+        // addresses are written as 0x followed by hex digits
+        const char* end = address.data() + address.size();
+        const char* digits = address.data() + (address.compare(0, 2, "0x") == 0 ? 2 : 0);
+        const auto [last, error] = std::from_chars(digits, end, entry.address_, 16);
+
+        if (error != std::errc() || last != end || digits == end) {
+            return false;
+        }
+
+        entries_.push_back(entry);
+    }
+
+    return true;
+}
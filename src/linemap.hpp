@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// words emitted for one source line, in rom order
+struct LineMapEntry {
+    uint32_t address_;
+    uint32_t words_;
+    uint32_t line_;
+};
+
+struct LineMap {
+    std::string source_;
+    std::vector<LineMapEntry> entries_;
+
+    // entry covering a rom address, nullptr for addresses past the program
+    const LineMapEntry* find(uint32_t address) const;
+
+    bool write(const std::string& file_name) const;
+    void write(std::ostream& out) const;
+
+    // the parts write is made of, for writing a map as it is built
+    static void write_header(std::ostream& out, const std::string& source);
+    static void write_entry(std::ostream& out, const LineMapEntry& entry);
+    bool read(const std::string& file_name);
+};
@@ -0,0 +1,407 @@
+#include "compiler.hpp"
+
+#include <cstring>
+
+// comma separated arguments of a macro use or the parameters of a .macro, blank text has none
+static std::vector<std::string_view> split_arguments(const std::string_view text) {
+    std::vector<std::string_view> arguments;
+
+    if (text.empty()) {
+        return arguments;
+    }
+
+    size_t start = 0;
+
+    while (true) {
+        const size_t comma = text.find(',', start);
+        const std::string_view argument = Lexer::trim(text.substr(start, comma == std::string_view::npos ? std::string_view::npos : comma - start));
+
+        // a trailing comma does not start a new argument, as with instruction operands
+        if (!argument.empty() || comma != std::string_view::npos) {
+            arguments.push_back(argument);
+        }
+
+        if (comma == std::string_view::npos) {
+            return arguments;
+        }
+
+        start = comma + 1;
+    }
+}
+
+Errors SCompiler::parse_line(const LexToken& source_line, LineReader& reader, const MacroArgs* args, const uint32_t depth) {
+    LexToken substituted;
+
+    // parameters are replaced operand by operand, the body was lexed once when the macro was defined
+    if (args != nullptr) {
+        substituted = source_line;
+
+        for (size_t operand = 0; operand < std::min(substituted.operand_count_, MAX_OPERANDS); ++operand) {
+            substituted.operands_[operand] = args->substitute(substituted.operands_[operand]);
+        }
+    }
+
+    const LexToken& line = args != nullptr ? substituted : source_line;
+
+    if (!line.label_.empty()) {
+        // a body is written more than once, so a label in it would be defined more than once
+        if (depth > 0) {
+            error(line.line_, "Label inside a .rep or macro body: " + std::string(line.label_) + " on line " + std::to_string(line.line_));
+            return invalid_label;
+        }
+
+        if (!check_label(line)) {
+            return invalid_label;
+        }
+
+        if (equs_.count(line.label_) > 0 || imports_.count(line.label_) > 0 || !labels_.emplace(line.label_, next_item()).second) {
+            error(line.line_, "Duplicate label: " + std::string(line.label_) + " on line " + std::to_string(line.line_));
+            return invalid_label;
+        }
+
+        if (line.mnemonic_.empty()) {
+            return OK;
+        }
+    }
+
+    if (!line.mnemonic_.empty() && line.mnemonic_[0] == '.') {
+        return parse_directive(line, reader, args, depth);
+    }
+
+    if (!macros_.empty() && find_instruction(line.mnemonic_) == nullptr) {
+        const auto macro = macros_.find(line.mnemonic_);
+
+        if (macro != macros_.end()) {
+            return expand_macro(line, macro->second, args, depth);
+        }
+    }
+
+    return parse_instruction(line);
+}
+
+bool SCompiler::constant_value(const std::string_view operand, uint16_t& value, const uint32_t line) {
+    const auto constant = equs_.find(operand);
+
+    if (constant != equs_.end()) {
+        value = constant->second;
+        return true;
+    }
+
+    if (is_valid_label(operand) && !is_valid_reg(operand)) {
+        error(line, "Undefined constant: " + std::string(operand) + " on line " + std::to_string(line));
+        return false;
+    }
+
+    if (!is_valid_imm(operand, value, line)) {
+        error(line, "Invalid immidate: " + std::string(operand) + " on line " + std::to_string(line));
+        return false;
+    }
+
+    return true;
+}
+
+Errors SCompiler::read_body(const LexToken& start, LineReader& reader, std::vector<LexToken>& body) {
+    const bool rep = start.mnemonic_ == ".rep";
+    const std::string_view open = rep ? ".rep" : ".macro";
+    const std::string_view close = rep ? ".endr" : ".endm";
+
+    uint32_t nested = 0;
+    LexToken line;
+
+    while (reader.next(line)) {
+        if (line.mnemonic_ == open) {
+            ++nested;
+        } else if (line.mnemonic_ == close) {
+            if (nested == 0 && !line.label_.empty()) {
+                error(line.line_, "Label inside a .rep or macro body: " + std::string(line.label_) + " on line " + std::to_string(line.line_));
+                return invalid_label;
+            }
+
+            if (nested == 0) {
+                return OK;
+            }
+
+            --nested;
+        }
+
+        body.push_back(line);
+    }
+
+    error(start.line_, "Missing " + std::string(close) + " for " + std::string(open) + " on line " + std::to_string(start.line_));
+    return invalid_instruction;
+}
+
+Errors SCompiler::parse_directive(const LexToken& line, LineReader& reader, const MacroArgs* args, const uint32_t depth) {
+    const std::string_view directive = line.mnemonic_;
+    const std::string on_line = " on line " + std::to_string(line.line_);
+
+    const bool takes_body = directive == ".rep" || directive == ".macro";
+    const bool symbols = directive == ".global" || directive == ".extern";
+
+    if (!takes_body && !symbols && directive != ".equ") {
+        error(line.line_, (directive == ".endr" || directive == ".endm" ? "Unexpected directive: " : "Invalid directive: ") + std::string(directive) + on_line);
+        return invalid_instruction;
+    }
+
+    // definitions are made once, so they can not go in a body that is expanded again
+    if (directive != ".rep" && depth > 0) {
+        error(line.line_, std::string(directive) + " inside a .rep or macro body" + on_line);
+        return invalid_instruction;
+    }
+
+    if (directive == ".equ") {
+        if (line.operand_count_ != 2) {
+            error(line.line_, "Invalid number of arguments for directive: .equ" + on_line);
+            return invalid_instruction;
+        }
+
+        const std::string_view name = line.operands_[0];
+        uint16_t value;
+
+        if (!is_valid_label(name) || is_valid_reg(name)) {
+            error(line.line_, "Invalid constant: " + std::string(name) + on_line);
+            return invalid_label;
+        }
+
+        if (labels_.count(name) > 0 || equs_.count(name) > 0 || imports_.count(name) > 0) {
+            error(line.line_, "Duplicate constant: " + std::string(name) + on_line);
+            return invalid_label;
+        }
+
+        if (!constant_value(line.operands_[1], value, line.line_)) {
+            return invalid_immediate;
+        }
+
+        equs_.emplace(name, value);
+        return OK;
+    }
+
+    // .global label, label exports labels from an object and .extern symbol, symbol imports labels of other objects
+    if (symbols) {
+        const std::vector<std::string_view> names = split_arguments(line.rest_);
+
+        if (names.empty()) {
+            error(line.line_, "Invalid number of arguments for directive: " + std::string(directive) + on_line);
+            return invalid_instruction;
+        }
+
+        for (const std::string_view name : names) {
+            if (!is_valid_label(name) || is_valid_reg(name)) {
+                error(line.line_, "Invalid label: " + std::string(name) + on_line);
+                return invalid_label;
+            }
+
+            if (directive == ".global") {
+                globals_.push_back({ name, line.line_ });
+                continue;
+            }
+
+            if (labels_.count(name) > 0 || equs_.count(name) > 0) {
+                error(line.line_, "Duplicate label: " + std::string(name) + on_line);
+                return invalid_label;
+            }
+
+            if (imports_.emplace(name, static_cast<uint32_t>(object_.imports_.size())).second) {
+                object_.imports_.push_back(std::string(name));
+            }
+        }
+
+        return OK;
+    }
+
+    if (directive == ".rep") {
+        uint16_t count;
+
+        if (line.operand_count_ != 1) {
+            error(line.line_, "Invalid number of arguments for directive: .rep" + on_line);
+            return invalid_instruction;
+        }
+
+        if (!constant_value(line.operands_[0], count, line.line_)) {
+            return invalid_immediate;
+        }
+
+        std::vector<LexToken> body;
+        const Errors result = read_body(line, reader, body);
+
+        if (result != OK || count == 0) {
+            return result;
+        }
+
+        if (depth + 1 >= MAX_EXPANSION_DEPTH) {
+            error(line.line_, "Expansion nested too deep: .rep" + on_line);
+            return invalid_instruction;
+        }
+
+        // the first pass is parsed and encoded, the others are copies of its words
+        const size_t first = next_item();
+        LineReader lines { body };
+        LexToken body_line;
+
+        while (lines.next(body_line)) {
+            const Errors body_result = parse_line(body_line, lines, args, depth + 1);
+
+            if (body_result != OK) {
+                return body_result;
+            }
+        }
+
+        repeat_items(first, next_item(), count - 1, line.line_);
+        return OK;
+    }
+
+    // .macro name param, param
+    const size_t name_end = std::min(line.rest_.find_first_of(" \t,"), line.rest_.size());
+    const std::string_view name = line.rest_.substr(0, name_end);
+
+    Macro macro { split_arguments(line.rest_.substr(name_end)), {}, line.line_ };
+
+    // a comma after the name is allowed too
+    if (!macro.params_.empty() && name_end < line.rest_.size() && line.rest_[name_end] == ',') {
+        macro.params_.erase(macro.params_.begin());
+    }
+
+    if (!is_valid_label(name) || name[0] == '.' || is_valid_reg(name) || find_instruction(name) != nullptr) {
+        error(line.line_, "Invalid macro name: " + std::string(name) + on_line);
+        return invalid_instruction;
+    }
+
+    if (macros_.count(name) > 0) {
+        error(line.line_, "Duplicate macro: " + std::string(name) + on_line);
+        return invalid_instruction;
+    }
+
+    for (size_t i = 0; i < macro.params_.size(); ++i) {
+        const std::string_view param = macro.params_[i];
+
+        if (!is_valid_label(param) || is_valid_reg(param) || std::find(macro.params_.begin(), macro.params_.begin() + i, param) != macro.params_.begin() + i) {
+            error(line.line_, "Invalid macro parameter: " + std::string(param) + on_line);
+            return invalid_instruction;
+        }
+    }
+
+    const Errors result = read_body(line, reader, macro.body_);
+
+    if (result == OK) {
+        macros_.emplace(name, std::move(macro));
+    }
+
+    return result;
+}
+
+Errors SCompiler::expand_macro(const LexToken& line, const Macro& macro, const MacroArgs* outer, const uint32_t depth) {
+    const std::string name(line.mnemonic_);
+    const std::string on_line = " on line " + std::to_string(line.line_);
+
+    if (depth + 1 >= MAX_EXPANSION_DEPTH) {
+        error(line.line_, "Expansion nested too deep: " + name + on_line);
+        return invalid_instruction;
+    }
+
+    MacroArgs args { &macro.params_, split_arguments(line.rest_) };
+
+    if (args.args_.size() != macro.params_.size()) {
+        error(line.line_, "Invalid number of arguments for macro: " + name + on_line);
+        return invalid_instruction;
+    }
+
+    // the key is the macro and its arguments as they are after the parameters of an outer macro are replaced
+    std::string key = name;
+
+    for (std::string_view& arg : args.args_) {
+        if (outer != nullptr) {
+            arg = outer->substitute(arg);
+        }
+
+        key += '\0';
+        key += arg;
+    }
+
+    // the same arguments give the same words, labels included, so a macro used again is a copy
+    const auto expanded = expansions_.find(key);
+
+    if (expanded != expansions_.end()) {
+        repeat_items(expanded->second.first, expanded->second.second, 1, line.line_);
+        return OK;
+    }
+
+    const size_t first = next_item();
+    LineReader lines { macro.body_ };
+    LexToken body_line;
+
+    while (lines.next(body_line)) {
+        const Errors result = parse_line(body_line, lines, &args, depth + 1);
+
+        if (result != OK) {
+            return result;
+        }
+    }
+
+    expansions_.emplace(std::move(key), std::make_pair(first, next_item()));
+
+    return OK;
+}
+
+void SCompiler::repeat_items(const size_t first, const size_t end, const uint32_t count, const uint32_t line) {
+    if (end > first && count > 0) {
+        copies_.push_back({ tokens_.size(), first, end, count, line });
+    }
+}
+
+void SCompiler::copy_words(const WordCopy& words) {
+    const size_t at = output_.size();
+
+    output_.resize(at + static_cast<size_t>(words.size_) * words.count_);
+
+    for (uint32_t pass = 0; pass < words.count_; ++pass) {
+        memcpy(output_.data() + at + static_cast<size_t>(pass) * words.size_, output_.data() + words.from_, words.size_ * sizeof(Word));
+    }
+
+    // the lines of a copy are the lines it was copied from
+    std::vector<LineMapEntry>& entries = line_map_.entries_;
+
+    const auto by_address = [](const LineMapEntry& entry, const uint32_t address) {
+        return entry.address_ < address;
+    };
+
+    const size_t first = std::lower_bound(entries.begin(), entries.end(), words.from_, by_address) - entries.begin();
+    const size_t last = std::lower_bound(entries.begin(), entries.end(), words.from_ + words.size_, by_address) - entries.begin();
+
+    entries.reserve(entries.size() + (last - first) * words.count_);
+
+    for (uint32_t pass = 0; pass < words.count_; ++pass) {
+        const uint32_t offset = static_cast<uint32_t>(at + static_cast<size_t>(pass) * words.size_ - words.from_);
+
+        for (size_t entry = first; entry < last; ++entry) {
+            LineMapEntry copy = entries[entry];
+            copy.address_ += offset;
+            entries.push_back(copy);
+        }
+    }
+
+    if (!write_object_) {
+        return;
+    }
+
+    // and the immediates holding an address, which are in address order like the entries
+    std::vector<Relocation>& relocations = object_.relocations_;
+
+    const auto by_offset = [](const Relocation& relocation, const uint32_t address) {
+        return relocation.offset_ < address;
+    };
+
+    const size_t first_relocation = std::lower_bound(relocations.begin(), relocations.end(), words.from_, by_offset) - relocations.begin();
+    const size_t last_relocation = std::lower_bound(relocations.begin(), relocations.end(), words.from_ + words.size_, by_offset) - relocations.begin();
+
+    relocations.reserve(relocations.size() + (last_relocation - first_relocation) * words.count_);
+
+    for (uint32_t pass = 0; pass < words.count_; ++pass) {
+        const uint32_t offset = static_cast<uint32_t>(at + static_cast<size_t>(pass) * words.size_ - words.from_);
+
+        for (size_t relocation = first_relocation; relocation < last_relocation; ++relocation) {
+            Relocation copy = relocations[relocation];
+            copy.offset_ += offset;
+            relocations.push_back(copy);
+        }
+    }
+}
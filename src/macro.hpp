@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "lexer.hpp"
+
+// macros and .rep blocks nested inside each other deeper than this are an error, a macro using itself stops here
+constexpr uint32_t MAX_EXPANSION_DEPTH = 64;
+
+// words a program may grow to through .rep and macro copies, far past anything rom can address
+constexpr uint64_t MAX_EXPANDED_WORDS = 1 << 28;
+
+// .macro name params ... .endm, the body is kept lexed and only parsed when the macro is used
+struct Macro {
+    std::vector<std::string_view> params_;
+    std::vector<LexToken> body_;
+    uint32_t line_;
+};
+
+// parameters of the macro being expanded and the arguments it was given for them
+struct MacroArgs {
+    const std::vector<std::string_view>* params_;
+    std::vector<std::string_view> args_;
+
+    // the argument given for a parameter, anything else is returned as it is
+    std::string_view substitute(std::string_view operand) const {
+        for (size_t i = 0; i < args_.size(); ++i) {
+            if ((*params_)[i] == operand) {
+                return args_[i];
+            }
+        }
+
+        return operand;
+    }
+};
+
+/*
+ * Encoded words of an earlier stretch of the program written again in front of token
+ * position_, for the passes of a .rep after the first and for a macro used again with the same
+ * arguments. Tokens and copies are numbered together in program order (items), and items
+ * first_ to end_ are written count_ more times without being parsed or encoded again.
+ */
+struct WordCopy {
+    size_t position_;
+    size_t first_;
+    size_t end_;
+    uint32_t count_;
+    uint32_t line_;
+
+    // words copied, known once resolve_labels has placed every item
+    uint32_t from_ = 0;
+    uint32_t size_ = 0;
+};
+
+// lines coming from the source, or from a body that has already been lexed
+class LineReader {
+    private:
+        Lexer* lexer_ = nullptr;
+        const std::vector<LexToken>* lines_ = nullptr;
+        size_t next_ = 0;
+
+    public:
+        LineReader() = delete;
+
+        explicit LineReader(Lexer& lexer) : lexer_(&lexer) {};
+        explicit LineReader(const std::vector<LexToken>& lines) : lines_(&lines) {};
+
+        bool next(LexToken& line) {
+            if (lexer_ != nullptr) {
+                return lexer_->next(line);
+            }
+
+            if (next_ == lines_->size()) {
+                return false;
+            }
+
+            line = (*lines_)[next_++];
+            return true;
+        }
+
+        ~LineReader() = default;
+};
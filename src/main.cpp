@@ -1,4 +1,130 @@
+#include <charconv>
+#include <filesystem>
+#include <memory>
+
+#include "batch.hpp"
+#include "cache.hpp"
 #include "compiler.hpp"
+#include "object.hpp"
+#include "stats.hpp"
+#include "watch.hpp"
+
+static void print_usage(const char* name) {
+    std::cout << "Usage: " << name << " <options?> <filename>" << " <output type?>" << std::endl;
+    std::cout << "       " << name << " <options?> <filename> <filename...> <output type?>" << std::endl;
+    std::cout << "Output types: S16, S8, D8" << std::endl;
+    std::cout << "Output formats: raw (v2.0 raw, the default), bin, ihex" << std::endl;
+    std::cout << "Use - as the filename to read from standard input" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -g    write out.map, mapping rom addresses to source lines for spl-emu -p" << std::endl;
+    std::cout << "  -O    optimize the generated code" << std::endl;
+    std::cout << "  -c    write a relocatable object (out.o, or <name>.o in batches) instead of the images" << std::endl;
+    std::cout << "  -f <format>     write the images as raw (.hex), bin (.bin) or ihex (.ihex)" << std::endl;
+    std::cout << "  --cache <dir>   reuse the output of unchanged sources compiled before with the same options" << std::endl;
+    std::cout << "  --cache-stats   print cache hits and misses for this run and in total" << std::endl;
+    std::cout << "  --watch         stay running and recompile each input whenever it is saved" << std::endl;
+    std::cout << "  --cost          print the words and cycles of each line, block and loop, and worst case bounds" << std::endl;
+    std::cout << "  --stream        compile a chunk at a time and write the images as they are encoded, memory stays flat" << std::endl;
+    std::cout << "  --link          link the objects given as filenames into one program, placed in the order given" << std::endl;
+    std::cout << "  --time-passes   print the time spent in each pass" << std::endl;
+    std::cout << "  --stats         print pass times, lines, instructions, words per instruction, bytes written and peak memory" << std::endl;
+    std::cout << "  --stats=json    print the same as json, last on standard output" << std::endl;
+    std::cout << "Batch options (used with several files, -m or -o):" << std::endl;
+    std::cout << "  -m <manifest>  compile the files listed in manifest, one '<input> <output?>' per line" << std::endl;
+    std::cout << "  -o <dir>       write each <name>.hex (and <name>.map) to dir instead of next to its input" << std::endl;
+    std::cout << "  -j <threads>   compile on this many threads (default one per core)" << std::endl;
+}
+
+static bool is_output_type(const std::string& arg) {
+    return arg == "D8" || arg == "S8" || arg == "S16";
+}
+
+// a last argument with no extension that names no file was meant as an output type, not as another input
+static bool is_unknown_output_type(const std::string& arg) {
+    return !is_output_type(arg) && arg != "-" && arg.find('.') == std::string::npos && !std::filesystem::exists(arg);
+}
+
+// the whole argument has to be a decimal number
+static bool parse_count(const char* text, size_t& out) {
+    const char* end = text + std::char_traits<char>::length(text);
+    const auto [last, error] = std::from_chars(text, end, out);
+
+    return error == std::errc() && last == end && last != text;
+}
+
+// a single file outside batch mode keeps the plain names (out.hex), like compiling it directly
+static bool collect_jobs(const std::vector<std::string>& args, const std::string& manifest, const std::string& output_dir, bool batch_mode, std::vector<BatchJob>& jobs) {
+    std::string error;
+
+    if (!batch_mode) {
+        jobs.push_back({ args[0], "" });
+        return true;
+    }
+
+    for (const std::string& input : args) {
+        jobs.push_back(make_job(input, output_dir));
+    }
+
+    if (!manifest.empty() && !read_manifest(manifest, output_dir, jobs, error)) {
+        std::cout << error << '\n';
+        return false;
+    }
+
+    return true;
+}
+
+// links objects written by -c and writes the images of the program, like a compile
+static int link_files(const std::vector<std::string>& files, const SCompiler& compiler) {
+    std::vector<ObjectFile> objects(files.size());
+    std::string error;
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!objects[i].read(files[i], error)) {
+            std::cout << error << '\n';
+            return 1;
+        }
+    }
+
+    const LinkResult result = link_objects(objects, files);
+
+    for (const std::string& message : result.errors_) {
+        std::cout << message << '\n';
+    }
+
+    if (!result.ok_) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::cout << "link: " << files[i] << " at 0x" << std::hex << result.bases_[i] << std::dec << ", " << objects[i].words_.size() << " words" << '\n';
+    }
+
+    FileSink sink;
+
+    if (!write_images(result.words_, compiler.output_type(), sink, compiler.format())) {
+        std::cout << (compiler.output_type() == HALF_SINGLE_WORD ? "Failed to open output files" : "Failed to open output file") << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+static void print_cache_stats(const CompileCache& cache) {
+    const CacheStats run = cache.stats();
+    CacheStats total;
+    cache.read_totals(total);
+
+    const uint64_t lookups = total.hits_ + total.misses_;
+
+    std::cout << "cache: " << run.hits_ << " hits, " << run.misses_ << " misses, " << run.stores_ << " stored" << '\n';
+    std::cout << "cache total: " << total.hits_ << " hits, " << total.misses_ << " misses";
+
+    if (lookups > 0) {
+        std::cout << " (" << total.hits_ * 100 / lookups << "% hit rate)";
+    }
+
+    std::cout << '\n';
+}
 
 int main(int argc, char** argv) {
     if (argc < 2) {
@@ -7,22 +133,178 @@ int main(int argc, char** argv) {
     }
 
     if (std::string(argv[1]) == "-h") {
-        std::cout << "Usage: " << argv[0] << " <filename>" << " <output type?>" << std::endl;
-        std::cout << "Output types: S16, S8, D8" << std::endl;
+        print_usage(argv[0]);
         return 0;
     }
 
     SCompiler compiler;
+    BatchOptions batch;
+    std::vector<std::string> args;
+    std::string manifest;
+    std::string output_dir;
+    std::string cache_dir;
+    bool cache_stats = false;
+    bool watching = false;
+    bool streaming = false;
+    bool cost_report = false;
+    bool linking = false;
+
+    enum { STATS_NONE, STATS_TIMES, STATS_TABLE, STATS_JSON } stats_mode = STATS_NONE;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        if (arg == "-g") {
+            compiler.set_line_map(true);
+            batch.line_map_ = true;
+        } else if (arg == "-O") {
+            compiler.set_optimize(true);
+            batch.optimize_ = true;
+        } else if (arg == "-c") {
+            compiler.set_object(true);
+            batch.object_ = true;
+        } else if (arg == "--link") {
+            linking = true;
+        } else if (arg == "-m" && i + 1 < argc) {
+            manifest = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            output_dir = argv[++i];
+        } else if (arg == "-j" && i + 1 < argc) {
+            if (!parse_count(argv[++i], batch.threads_)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (arg == "--cache-stats") {
+            cache_stats = true;
+        } else if (arg == "--watch") {
+            watching = true;
+        } else if (arg == "--cost") {
+            compiler.set_cost_report(true);
+            cost_report = true;
+        } else if (arg == "--stream") {
+            streaming = true;
+        } else if (arg == "--time-passes") {
+            stats_mode = STATS_TIMES;
+        } else if (arg == "--stats") {
+            stats_mode = STATS_TABLE;
+        } else if (arg == "--stats=json") {
+            stats_mode = STATS_JSON;
+        } else if (arg == "-f" && i + 1 < argc) {
+            OutputFormats format;
+
+            if (!parse_format(argv[++i], format)) {
+                std::cout << "Unknown output format: " << argv[i] << ", use raw, bin or ihex" << std::endl;
+                return 1;
+            }
+
+            compiler.set_format(format);
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() >= 2 && is_unknown_output_type(args.back())) {
+        std::cout << "Unknown output type: " << args.back() << ", use S16, S8 or D8" << std::endl;
+        return 1;
+    }
 
-    if (argc == 3) {
-        bool ok = compiler.set_output(argv[2]);
+    // a trailing output type applies to every file
+    if (!args.empty() && (args.size() >= 2 || !manifest.empty()) && is_output_type(args.back())) {
+        compiler.set_output(args.back());
+        args.pop_back();
+    }
 
-        if (!ok) {
-            std::cout << "Usage: " << argv[0] << " <filename>" << " <output type>" << std::endl;
-            std::cout << "use -h for help" << std::endl;
+    if (linking) {
+        if (args.empty() || batch.object_ || batch.optimize_ || batch.line_map_ || watching || streaming || cost_report || !manifest.empty() || !output_dir.empty() || !cache_dir.empty()) {
+            std::cout << "--link takes the objects to link and an output type, and cannot be used with other options but -f" << std::endl;
             return 1;
         }
+
+        return link_files(args, compiler);
+    }
+
+    if (batch.object_ && (batch.optimize_ || batch.line_map_ || streaming || cost_report)) {
+        std::cout << "-c cannot be used with -O, -g, --stream or --cost, the program is only complete once it is linked" << std::endl;
+        return 1;
+    }
+
+    const bool batch_mode = args.size() > 1 || !manifest.empty() || !output_dir.empty();
+
+    if ((args.empty() && manifest.empty()) || (!batch_mode && args.size() != 1)) {
+        std::cout << "Usage: " << argv[0] << " <filename>" << " <output type>" << std::endl;
+        std::cout << "use -h for help" << std::endl;
+        return 1;
+    }
+
+    if (streaming && (batch_mode || watching || batch.optimize_ || !cache_dir.empty())) {
+        std::cout << "--stream compiles a single file and cannot be used with -O, --cache, --watch or batch options" << std::endl;
+        return 1;
+    }
+
+    if (cost_report && (batch_mode || watching || streaming || !cache_dir.empty())) {
+        std::cout << "--cost compiles a single file and cannot be used with --cache, --stream, --watch or batch options" << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<CompileCache> cache;
+    std::string error;
+
+    if (!cache_dir.empty()) {
+        cache = std::make_unique<CompileCache>(cache_dir);
+
+        if (!cache->open(error)) {
+            std::cout << error << '\n';
+            return 1;
+        }
+
+        compiler.set_cache(cache.get());
+        batch.cache_ = cache.get();
+    }
+
+    CompileStats stats;
+
+    if (stats_mode != STATS_NONE) {
+        compiler.set_stats(&stats);
+        batch.stats_ = &stats;
+    }
+
+    std::vector<BatchJob> jobs;
+    int status = 1;
+
+    batch.output_type_ = compiler.output_type();
+    batch.format_ = compiler.format();
+
+    if (watching) {
+        if (collect_jobs(args, manifest, output_dir, batch_mode, jobs)) {
+            status = watch(jobs, batch, std::cout);
+        }
+    } else if (streaming) {
+        status = compiler.compile_stream(args[0]);
+    } else if (!batch_mode) {
+        status = compiler.compile(args[0]);
+    } else if (collect_jobs(args, manifest, output_dir, batch_mode, jobs)) {
+        status = run_batch(jobs, batch, std::cout) == 0 ? 0 : 1;
+    }
+
+    if (cache) {
+        cache->record_totals();
+    }
+
+    if (cache && cache_stats) {
+        print_cache_stats(*cache);
+    }
+
+    if (stats_mode != STATS_NONE) {
+        stats.sample_memory();
+    }
+
+    if (stats_mode == STATS_JSON) {
+        stats.print_json(std::cout);
+    } else if (stats_mode != STATS_NONE) {
+        stats.print_table(std::cout, stats_mode == STATS_TABLE);
     }
 
-    return compiler.compile(argv[1]);
-}
\ No newline at end of file
+    return status;
+}
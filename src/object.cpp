@@ -0,0 +1,219 @@
+#include "object.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+
+/*
+ * object files are plain text:
+ *   spl-obj v1
+ *   words <count>
+ *   <hex words, 16 to a line>
+ *   export <name> <hex offset>
+ *   import <name>
+ *   reloc <hex offset> section
+ *   reloc <hex offset> import <index>
+ */
+
+constexpr size_t OBJECT_WORDS_PER_LINE = 16;
+
+void ObjectFile::write(std::ostream& out) const {
+    out << "spl-obj v1\n";
+    out << "words " << words_.size() << '\n';
+    out << std::hex << std::uppercase << std::setfill('0');
+
+    for (size_t i = 0; i < words_.size(); ++i) {
+        out << std::setw(4) << words_[i] << ((i + 1) % OBJECT_WORDS_PER_LINE == 0 || i + 1 == words_.size() ? '\n' : ' ');
+    }
+
+    out << std::nouppercase;
+
+    for (const ObjectSymbol& symbol : exports_) {
+        out << "export " << symbol.name_ << " 0x" << symbol.offset_ << '\n';
+    }
+
+    for (const std::string& name : imports_) {
+        out << "import " << name << '\n';
+    }
+
+    for (const Relocation& relocation : relocations_) {
+        out << "reloc 0x" << relocation.offset_;
+
+        if (relocation.kind_ == RELOC_SECTION) {
+            out << " section\n";
+        } else {
+            out << " import " << std::dec << relocation.import_ << std::hex << '\n';
+        }
+    }
+
+    out << std::dec << std::setfill(' ');
+}
+
+bool ObjectFile::read(std::istream& in, std::string& error) {
+    std::string line;
+    size_t number = 1;
+    size_t count = 0;
+
+    *this = ObjectFile();
+
+    if (!std::getline(in, line) || line != "spl-obj v1") {
+        error = "not an spl object";
+        return false;
+    }
+
+    if (!std::getline(in, line) || line.compare(0, 6, "words ") != 0 || !(std::istringstream(line.substr(6)) >> count)) {
+        error = "line 2: expected the word count";
+        return false;
+    }
+
+    words_.reserve(count);
+
+    for (number = 3; words_.size() < count && std::getline(in, line); ++number) {
+        std::istringstream stream { line };
+        std::string word;
+
+        while (stream >> word && words_.size() < count) {
+            words_.push_back(static_cast<Word>(std::stoul(word, nullptr, 16)));
+        }
+    }
+
+    if (words_.size() != count) {
+        error = "expected " + std::to_string(count) + " words, found " + std::to_string(words_.size());
+        return false;
+    }
+
+    for (; std::getline(in, line); ++number) {
+        std::istringstream stream { line };
+        std::string kind;
+        std::string name;
+        std::string offset;
+
+        if (!(stream >> kind)) {
+            continue;
+        }
+
+        bool valid = false;
+
+        if (kind == "export" && stream >> name >> offset) {
+            exports_.push_back({ name, static_cast<uint32_t>(std::stoul(offset, nullptr, 16)) });
+            valid = exports_.back().offset_ <= words_.size();
+        } else if (kind == "import" && stream >> name) {
+            imports_.push_back(name);
+            valid = true;
+        } else if (kind == "reloc" && stream >> offset >> name) {
+            Relocation relocation { static_cast<uint32_t>(std::stoul(offset, nullptr, 16)), RELOC_SECTION };
+
+            if (name == "import") {
+                relocation.kind_ = RELOC_IMPORT;
+                valid = static_cast<bool>(stream >> relocation.import_) && relocation.import_ < imports_.size();
+            } else {
+                valid = name == "section";
+            }
+
+            valid = valid && relocation.offset_ < words_.size();
+            relocations_.push_back(relocation);
+        }
+
+        if (!valid) {
+            error = "line " + std::to_string(number) + ": " + line;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ObjectFile::read(const std::string& file_name, std::string& error) {
+    std::ifstream file { file_name };
+
+    if (!file.is_open()) {
+        error = "File not found: " + file_name;
+        return false;
+    }
+
+    try {
+        if (read(file, error)) {
+            return true;
+        }
+    } catch (const std::logic_error&) {
+        // stoul on something that is not a number
+        error = "invalid number";
+    }
+
+    error = "Invalid object file: " + file_name + ", " + error;
+    return false;
+}
+
+LinkResult link_objects(const std::vector<ObjectFile>& objects, const std::vector<std::string>& names) {
+    LinkResult result;
+
+    // where every object goes
+    uint64_t address = 0;
+
+    for (const ObjectFile& object : objects) {
+        result.bases_.push_back(static_cast<uint32_t>(address));
+        address += object.words_.size();
+    }
+
+    // every export with its address in the image and the object it came from
+    std::unordered_map<std::string, std::pair<uint64_t, size_t>> symbols;
+
+    for (size_t i = 0; i < objects.size(); ++i) {
+        for (const ObjectSymbol& symbol : objects[i].exports_) {
+            const auto [existing, inserted] = symbols.try_emplace(symbol.name_, result.bases_[i] + static_cast<uint64_t>(symbol.offset_), i);
+
+            if (!inserted) {
+                result.errors_.push_back("Duplicate symbol: " + symbol.name_ + " in " + names[i] + " and " + names[existing->second.second]);
+            }
+        }
+    }
+
+    result.words_.reserve(address);
+
+    for (size_t i = 0; i < objects.size(); ++i) {
+        const ObjectFile& object = objects[i];
+        const size_t base = result.bases_[i];
+
+        result.words_.insert(result.words_.end(), object.words_.begin(), object.words_.end());
+
+        // imports resolved once per object, not once per relocation
+        std::vector<int64_t> imports(object.imports_.size(), -1);
+
+        for (size_t import = 0; import < object.imports_.size(); ++import) {
+            const auto symbol = symbols.find(object.imports_[import]);
+
+            if (symbol != symbols.end()) {
+                imports[import] = static_cast<int64_t>(symbol->second.first);
+            } else {
+                result.errors_.push_back("Undefined symbol: " + object.imports_[import] + " imported by " + names[i]);
+            }
+        }
+
+        for (const Relocation& relocation : object.relocations_) {
+            Word& slot = result.words_[base + relocation.offset_];
+            int64_t target = base + static_cast<int64_t>(slot);
+
+            if (relocation.kind_ == RELOC_IMPORT) {
+                target = imports[relocation.import_];
+            }
+
+            if (target < 0) {
+                continue;
+            }
+
+            if (target > 0xFFFF) {
+                std::ostringstream message;
+                message << "Relocation out of range: 0x" << std::hex << target << " at offset 0x" << relocation.offset_ << " of " << names[i];
+                result.errors_.push_back(message.str());
+                continue;
+            }
+
+            slot = static_cast<Word>(target);
+        }
+    }
+
+    result.ok_ = result.errors_.empty();
+
+    return result;
+}
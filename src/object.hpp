@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "isa.hpp"
+
+// a label an object exports (.global), at a word offset into its words
+struct ObjectSymbol {
+    std::string name_;
+    uint32_t offset_;
+};
+
+enum RelocationKinds {
+    RELOC_SECTION, // the slot holds an offset into the object's own words, the object's address is added
+    RELOC_IMPORT // the slot gets the address of an imported symbol
+};
+
+// an immediate slot holding an address, offset_ is the word the immediate is in
+struct Relocation {
+    uint32_t offset_;
+    RelocationKinds kind_;
+
+    // index into imports_ for RELOC_IMPORT
+    uint32_t import_ = 0;
+};
+
+/*
+ * A compiled module that is not placed yet: its words as if it started at address 0, the labels
+ * it exports, the symbols it imports (.extern) and every immediate that holds an address, so
+ * the linker can move it anywhere in rom. Written as text, like the line map.
+ */
+struct ObjectFile {
+    std::vector<Word> words_;
+    std::vector<ObjectSymbol> exports_;
+    std::vector<std::string> imports_;
+    std::vector<Relocation> relocations_;
+
+    void write(std::ostream& out) const;
+
+    // error names the line that could not be read
+    bool read(std::istream& in, std::string& error);
+    bool read(const std::string& file_name, std::string& error);
+};
+
+struct LinkResult {
+    bool ok_ = false;
+    std::vector<Word> words_;
+
+    // address each object was placed at, in the order they were given
+    std::vector<uint32_t> bases_;
+    std::vector<std::string> errors_;
+};
+
+/*
+ * Places the objects one after the other from address 0 in the order given, so the first one
+ * holds the entry point, then resolves every import against the exports and patches the
+ * relocations. names_ are used in errors.
+ */
+LinkResult link_objects(const std::vector<ObjectFile>& objects, const std::vector<std::string>& names);
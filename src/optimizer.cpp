@@ -0,0 +1,1885 @@
+#include "optimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+// what an op reads or writes, following the semantics spl-emu implements
+enum Locations : uint16_t {
+    LOC_A = 1 << 0,
+    LOC_B = 1 << 1,
+    LOC_C = 1 << 2,
+    LOC_ACC = 1 << 3,
+    LOC_FLGS = 1 << 4,
+    LOC_LGC = 1 << 5,
+    LOC_NUMBR = 1 << 6,
+    LOC_MAR = 1 << 7,
+    LOC_RAM = 1 << 8,
+    LOC_PC = 1 << 9,
+    LOC_ALL = (1 << 10) - 1
+};
+
+// longest run of ops a pattern looks at
+constexpr size_t PEEPHOLE_WINDOW = 32;
+
+static uint16_t source_location(const uint16_t code) {
+    switch (code) {
+        case(A_TO_BUS):
+            return LOC_A;
+        case(B_TO_BUS):
+            return LOC_B;
+        case(C_TO_BUS):
+            return LOC_C;
+        case(ACC_TO_BUS):
+            return LOC_ACC;
+        case(FLGS_TO_BUS):
+            return LOC_FLGS;
+        case(LGC_TO_BUS):
+            return LOC_LGC;
+        case(BUS_RAM):
+            return LOC_RAM | LOC_MAR;
+        default:
+            return 0;
+    }
+}
+
+static uint16_t dest_location(const uint16_t code) {
+    switch (code) {
+        case(A_FROM_BUS):
+            return LOC_A;
+        case(B_FROM_BUS):
+            return LOC_B;
+        case(C_FROM_BUS):
+            return LOC_C;
+        case(BUS_NUMBR):
+            return LOC_NUMBR;
+        case(BUS_MAR):
+            return LOC_MAR;
+        default:
+            return 0;
+    }
+}
+
+static bool is_exec(const MicroOp& op) {
+    return op.word_ == make_word(ALU_NONE, BUS_RAM, BUS_RAM, FLAG_NONE);
+}
+
+static bool is_halt(const MicroOp& op) {
+    return word_src(op.word_) == BUS_HLT;
+}
+
+static bool is_jump(const MicroOp& op) {
+    const uint16_t dest = word_dest(op.word_);
+
+    return word_alu(op.word_) == ALU_NONE && (dest == BUS_PC || dest == BUS_JE || dest == BUS_JNE);
+}
+
+// one of the word shapes the encoders emit, anything else is treated as touching everything
+static bool is_known(const MicroOp& op) {
+    const uint16_t alu = word_alu(op.word_);
+    const uint16_t dest = word_dest(op.word_);
+    const uint16_t src = word_src(op.word_);
+    const uint16_t flags = word_flags(op.word_);
+
+    if (is_exec(op) || op.word_ == make_word(ALU_NONE, BUS_NONE, BUS_HLT, FLAG_NONE)) {
+        return true;
+    }
+
+    const bool source_ok = (flags == FLAG_IMM && src == BUS_NONE) || (flags == FLAG_NONE && source_location(src) != 0);
+
+    switch (alu) {
+        case(ALU_NONE):
+            return source_ok && (dest_location(dest) != 0 || is_jump(op));
+        case(ALU_ADD):
+        case(ALU_SUB):
+        case(ALU_CMP):
+            return source_ok && dest == BUS_NONE;
+        case(ALU_RAM_WR):
+            return dest == BUS_WR && flags == FLAG_WR && source_location(src) != 0;
+        default:
+            return false;
+    }
+}
+
+static uint16_t reads(const MicroOp& op) {
+    if (is_exec(op) || !is_known(op)) {
+        return LOC_ALL;
+    }
+
+    uint16_t locations = 0;
+
+    if (word_flags(op.word_) != FLAG_IMM) {
+        locations |= source_location(word_src(op.word_));
+    }
+
+    switch (word_alu(op.word_)) {
+        case(ALU_ADD):
+        case(ALU_SUB):
+        case(ALU_CMP):
+            locations |= LOC_NUMBR;
+            break;
+        case(ALU_RAM_WR):
+            locations |= LOC_MAR;
+            break;
+        default:
+            break;
+    }
+
+    const uint16_t dest = word_dest(op.word_);
+
+    if (word_alu(op.word_) == ALU_NONE && (dest == BUS_JE || dest == BUS_JNE)) {
+        locations |= LOC_LGC;
+    }
+
+    return locations;
+}
+
+static uint16_t writes(const MicroOp& op) {
+    if (is_exec(op) || !is_known(op)) {
+        return LOC_ALL;
+    }
+
+    if (is_halt(op)) {
+        return LOC_PC;
+    }
+
+    switch (word_alu(op.word_)) {
+        case(ALU_ADD):
+        case(ALU_SUB):
+        case(ALU_CMP):
+            return LOC_ACC | LOC_FLGS | LOC_LGC;
+        case(ALU_RAM_WR):
+            return LOC_RAM;
+        default:
+            break;
+    }
+
+    return is_jump(op) ? static_cast<uint16_t>(LOC_PC) : dest_location(word_dest(op.word_));
+}
+
+static bool ends_block(const MicroOp& op) {
+    return writes(op) & LOC_PC;
+}
+
+// plain register load: dest register gets the bus and nothing else changes
+static bool is_move(const MicroOp& op) {
+    return word_alu(op.word_) == ALU_NONE && is_known(op) && !is_exec(op) && dest_location(word_dest(op.word_)) != 0;
+}
+
+static bool same_op(const MicroOp& a, const MicroOp& b) {
+    return a.word_ == b.word_ && a.has_imm_ == b.has_imm_ && (!a.has_imm_ || a.imm_ == b.imm_);
+}
+
+// locations whose change would make a move load something different
+static uint16_t move_inputs(const MicroOp& op) {
+    return op.has_imm_ ? 0 : source_location(word_src(op.word_));
+}
+
+using PatternFunction = bool (*)(std::vector<MicroOp>& ops, const std::vector<size_t>& window);
+
+struct PeepholePattern {
+    const char* name_;
+    PatternFunction apply_;
+};
+
+// mov a, a
+static bool self_move(std::vector<MicroOp>& ops, const std::vector<size_t>& window) {
+    MicroOp& op = ops[window[0]];
+
+    if (!is_move(op) || op.has_imm_ || move_inputs(op) != dest_location(word_dest(op.word_))) {
+        return false;
+    }
+
+    op.removed_ = true;
+    return true;
+}
+
+// mov a, b / mov a, c: the first value is overwritten before anything reads it
+static bool dead_move(std::vector<MicroOp>& ops, const std::vector<size_t>& window) {
+    if (window.size() < 2) {
+        return false;
+    }
+
+    MicroOp& first = ops[window[0]];
+    const MicroOp& second = ops[window[1]];
+
+    if (!is_move(first)) {
+        return false;
+    }
+
+    const uint16_t dest = dest_location(word_dest(first.word_));
+
+    if (!(writes(second) & dest) || (reads(second) & dest)) {
+        return false;
+    }
+
+    first.removed_ = true;
+    return true;
+}
+
+// mov a, b / mov b, a: b already holds a
+static bool move_back(std::vector<MicroOp>& ops, const std::vector<size_t>& window) {
+    if (window.size() < 2) {
+        return false;
+    }
+
+    const MicroOp& first = ops[window[0]];
+    MicroOp& second = ops[window[1]];
+
+    if (!is_move(first) || !is_move(second) || first.has_imm_ || second.has_imm_) {
+        return false;
+    }
+
+    const uint16_t first_src = move_inputs(first);
+    const uint16_t first_dest = dest_location(word_dest(first.word_));
+
+    if (first_src == 0 || (first_src & LOC_RAM) || move_inputs(second) != first_dest || dest_location(word_dest(second.word_)) != first_src) {
+        return false;
+    }
+
+    second.removed_ = true;
+    return true;
+}
+
+// the same load again (mar for repeated wr/rd/exec, numbr for alu operands) while neither side changed
+static bool reload(std::vector<MicroOp>& ops, const std::vector<size_t>& window) {
+    const MicroOp& first = ops[window[0]];
+
+    if (!is_move(first)) {
+        return false;
+    }
+
+    const uint16_t dest = dest_location(word_dest(first.word_));
+    const uint16_t inputs = move_inputs(first);
+
+    if (inputs & dest) {
+        return false;
+    }
+
+    for (size_t i = 1; i < window.size(); ++i) {
+        MicroOp& op = ops[window[i]];
+
+        if (same_op(first, op)) {
+            op.removed_ = true;
+            return true;
+        }
+
+        if (writes(op) & (dest | inputs)) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+// jmp/je/jne to the op that runs next anyway
+static bool jump_to_next(std::vector<MicroOp>& ops, const std::vector<size_t>& window) {
+    MicroOp& op = ops[window[0]];
+
+    if (!is_jump(op) || !op.has_imm_ || op.target_ < 0) {
+        return false;
+    }
+
+    size_t next = window[0] + 1;
+
+    while (next < ops.size() && ops[next].removed_) {
+        ++next;
+    }
+
+    if (static_cast<int64_t>(next) != op.target_) {
+        return false;
+    }
+
+    op.removed_ = true;
+    return true;
+}
+
+static const PeepholePattern patterns[] = {
+    { "self move", self_move },
+    { "dead move", dead_move },
+    { "move back", move_back },
+    { "reload", reload },
+    { "jump to next", jump_to_next },
+};
+
+void Optimizer::count(const std::string& name, uint32_t rewrites) {
+    for (auto& [pattern, total] : stats_.rewrites_) {
+        if (pattern == name) {
+            total += rewrites;
+            return;
+        }
+    }
+
+    stats_.rewrites_.push_back({ name, rewrites });
+}
+
+void Optimizer::load(const std::vector<Word>& words, const LineMap& map, const std::vector<std::pair<uint32_t, uint32_t>>& register_jumps) {
+    ops_.clear();
+    relocatable_ = true;
+    stats_ = OptimizerStats();
+    stats_.words_before_ = static_cast<uint32_t>(words.size());
+
+    size_t entry = 0;
+
+    for (size_t address = 0; address < words.size();) {
+        MicroOp op;
+        op.word_ = words[address];
+        op.address_ = static_cast<uint32_t>(address);
+        op.has_imm_ = word_flags(op.word_) == FLAG_IMM;
+
+        if (op.has_imm_) {
+            if (address + 1 >= words.size()) {
+                relocatable_ = false;
+                stats_.skipped_ = "immediate missing at the end of the program";
+                break;
+            }
+
+            op.imm_ = words[address + 1];
+        }
+
+        while (entry < map.entries_.size() && map.entries_[entry].address_ + map.entries_[entry].words_ <= address) {
+            ++entry;
+        }
+
+        if (entry < map.entries_.size()) {
+            op.line_ = map.entries_[entry].line_;
+            op.starts_entry_ = map.entries_[entry].address_ == address;
+        }
+
+        address += op.size();
+        ops_.push_back(op);
+    }
+
+    if (!ops_.empty()) {
+        ops_[0].is_target_ = true;
+    }
+
+    for (MicroOp& op : ops_) {
+        uint32_t destination = op.imm_;
+        bool resolved = op.has_imm_;
+
+        if (is_jump(op) && !op.has_imm_) {
+            const auto known = std::find_if(register_jumps.begin(), register_jumps.end(), [&](const auto& jump) { return jump.first == op.address_; });
+
+            if (known != register_jumps.end()) {
+                destination = known->second;
+                resolved = true;
+            }
+        }
+
+        if (is_exec(op) || (is_jump(op) && !resolved)) {
+            relocatable_ = false;
+            stats_.skipped_ = "program jumps through a register or executes ram";
+            continue;
+        }
+
+        if (!is_jump(op) || destination >= words.size()) {
+            continue;
+        }
+
+        auto target = std::lower_bound(ops_.begin(), ops_.end(), destination, [](const MicroOp& candidate, uint32_t address) {
+            return candidate.address_ < address;
+        });
+
+        if (target == ops_.end() || target->address_ != destination) {
+            relocatable_ = false;
+            stats_.skipped_ = "a jump lands inside an instruction";
+            continue;
+        }
+
+        op.target_ = target - ops_.begin();
+        target->is_target_ = true;
+    }
+}
+
+bool Optimizer::peephole() {
+    if (!relocatable_) {
+        return false;
+    }
+
+    std::vector<size_t> window;
+    bool changed = true;
+    bool rewrote = false;
+
+    while (changed) {
+        changed = false;
+
+        for (size_t i = 0; i < ops_.size(); ++i) {
+            if (ops_[i].removed_) {
+                continue;
+            }
+
+            // ops after i in the same basic block
+            window.clear();
+            window.push_back(i);
+
+            for (size_t j = i + 1; j < ops_.size() && !ends_block(ops_[window.back()]) && window.size() < PEEPHOLE_WINDOW; ++j) {
+                if (ops_[j].is_target_) {
+                    break;
+                }
+
+                if (!ops_[j].removed_) {
+                    window.push_back(j);
+                }
+            }
+
+            for (const PeepholePattern& pattern : patterns) {
+                if (pattern.apply_(ops_, window)) {
+                    count(pattern.name_, 1);
+                    changed = true;
+                    rewrote = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    return rewrote;
+}
+
+size_t Optimizer::next_live(size_t index) const {
+    while (index < ops_.size() && ops_[index].removed_) {
+        ++index;
+    }
+
+    return index;
+}
+
+void Optimizer::mark_targets() {
+    for (MicroOp& op : ops_) {
+        op.is_target_ = false;
+    }
+
+    if (!ops_.empty()) {
+        ops_[0].is_target_ = true;
+    }
+
+    for (const MicroOp& op : ops_) {
+        if (!op.removed_ && op.target_ >= 0) {
+            ops_[op.target_].is_target_ = true;
+        }
+    }
+}
+
+void Optimizer::build_blocks() {
+    // rewrites may have left ops nothing jumps to any more, they no longer split blocks
+    mark_targets();
+    blocks_.clear();
+
+    // block index of every live op that starts a block
+    std::vector<size_t> block_at(ops_.size() + 1, SIZE_MAX);
+    bool leader = true;
+
+    for (size_t i = 0; i < ops_.size(); ++i) {
+        leader = leader || ops_[i].is_target_;
+
+        if (ops_[i].removed_) {
+            continue;
+        }
+
+        if (leader) {
+            block_at[i] = blocks_.size();
+            blocks_.push_back(BasicBlock { i, i, {}, {}, false });
+            leader = false;
+        }
+
+        blocks_.back().last_ = i;
+        leader = ends_block(ops_[i]);
+    }
+
+    auto link = [&](size_t from, size_t op) {
+        if (op >= ops_.size()) {
+            blocks_[from].exits_ = true;
+            return;
+        }
+
+        const size_t to = block_at[op];
+        blocks_[from].successors_.push_back(to);
+        blocks_[to].predecessors_.push_back(from);
+    };
+
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        const MicroOp& last = ops_[blocks_[b].last_];
+        const size_t next = next_live(blocks_[b].last_ + 1);
+
+        if (is_halt(last)) {
+            blocks_[b].exits_ = true;
+            continue;
+        }
+
+        if (!is_jump(last)) {
+            link(b, next);
+            continue;
+        }
+
+        if (word_dest(last.word_) != BUS_PC) {
+            link(b, next);
+        }
+
+        if (last.target_ >= 0) {
+            const size_t target = next_live(last.target_);
+
+            if (target != next || word_dest(last.word_) == BUS_PC) {
+                link(b, target);
+            }
+        } else {
+            blocks_[b].exits_ = true;
+        }
+    }
+}
+
+void Optimizer::analyze(const std::vector<Word>& words, const LineMap& map, const std::vector<std::pair<uint32_t, uint32_t>>& register_jumps) {
+    load(words, map, register_jumps);
+    build_blocks();
+}
+
+bool NaturalLoop::contains(const size_t block) const {
+    return std::binary_search(blocks_.begin(), blocks_.end(), block);
+}
+
+std::vector<size_t> reverse_postorder(const std::vector<BasicBlock>& blocks) {
+    std::vector<size_t> order;
+
+    if (blocks.empty()) {
+        return order;
+    }
+
+    // block and the next successor to visit from it
+    std::vector<std::pair<size_t, size_t>> stack { { 0, 0 } };
+    std::vector<bool> seen(blocks.size(), false);
+    seen[0] = true;
+
+    while (!stack.empty()) {
+        const size_t block = stack.back().first;
+        const size_t next = stack.back().second++;
+
+        if (next < blocks[block].successors_.size()) {
+            const size_t successor = blocks[block].successors_[next];
+
+            if (!seen[successor]) {
+                seen[successor] = true;
+                stack.push_back({ successor, 0 });
+            }
+
+            continue;
+        }
+
+        order.push_back(block);
+        stack.pop_back();
+    }
+
+    std::reverse(order.begin(), order.end());
+
+    return order;
+}
+
+std::vector<NaturalLoop> find_loops(const std::vector<BasicBlock>& blocks) {
+    const std::vector<size_t> order = reverse_postorder(blocks);
+
+    std::vector<size_t> position(blocks.size(), SIZE_MAX);
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        position[order[i]] = i;
+    }
+
+    // immediate dominators, found by iterating over the blocks in reverse postorder until nothing changes
+    std::vector<size_t> idom(blocks.size(), SIZE_MAX);
+    std::vector<NaturalLoop> loops;
+
+    if (order.empty()) {
+        return loops;
+    }
+
+    idom[order[0]] = order[0];
+
+    auto intersect = [&](size_t a, size_t b) {
+        while (a != b) {
+            while (position[a] > position[b]) {
+                a = idom[a];
+            }
+
+            while (position[b] > position[a]) {
+                b = idom[b];
+            }
+        }
+
+        return a;
+    };
+
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (size_t i = 1; i < order.size(); ++i) {
+            size_t dominator = SIZE_MAX;
+
+            for (const size_t predecessor : blocks[order[i]].predecessors_) {
+                if (idom[predecessor] != SIZE_MAX) {
+                    dominator = dominator == SIZE_MAX ? predecessor : intersect(predecessor, dominator);
+                }
+            }
+
+            if (dominator != idom[order[i]]) {
+                idom[order[i]] = dominator;
+                changed = true;
+            }
+        }
+    }
+
+    auto dominates = [&](const size_t header, size_t block) {
+        while (block != header && block != order[0]) {
+            block = idom[block];
+        }
+
+        return block == header;
+    };
+
+    // an edge to a block that dominates its source is a back edge, its target heads a loop
+    for (const size_t block : order) {
+        for (const size_t successor : blocks[block].successors_) {
+            if (!dominates(successor, block)) {
+                continue;
+            }
+
+            auto loop = std::find_if(loops.begin(), loops.end(), [&](const NaturalLoop& candidate) {
+                return candidate.header_ == successor;
+            });
+
+            if (loop == loops.end()) {
+                loops.push_back(NaturalLoop { successor, { successor }, {} });
+                loop = loops.end() - 1;
+            }
+
+            loop->latches_.push_back(block);
+        }
+    }
+
+    // the body is everything that reaches a latch without going through the header
+    for (NaturalLoop& loop : loops) {
+        std::vector<bool> in_loop(blocks.size(), false);
+        std::vector<size_t> work = loop.latches_;
+        in_loop[loop.header_] = true;
+
+        while (!work.empty()) {
+            const size_t block = work.back();
+            work.pop_back();
+
+            if (in_loop[block]) {
+                continue;
+            }
+
+            in_loop[block] = true;
+            loop.blocks_.push_back(block);
+
+            for (const size_t predecessor : blocks[block].predecessors_) {
+                if (position[predecessor] != SIZE_MAX && !in_loop[predecessor]) {
+                    work.push_back(predecessor);
+                }
+            }
+        }
+
+        std::sort(loop.blocks_.begin(), loop.blocks_.end());
+    }
+
+    std::sort(loops.begin(), loops.end(), [](const NaturalLoop& a, const NaturalLoop& b) {
+        return a.blocks_.size() != b.blocks_.size() ? a.blocks_.size() > b.blocks_.size() : a.header_ < b.header_;
+    });
+
+    // the smallest loop before this one that holds its header is the one it sits in
+    for (size_t i = 0; i < loops.size(); ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            if (loops[j].contains(loops[i].header_)) {
+                loops[i].parent_ = static_cast<int64_t>(j);
+                loops[i].depth_ = loops[j].depth_ + 1;
+            }
+        }
+    }
+
+    return loops;
+}
+
+/*
+ * Forward value tracking. Every tracked register holds a value id: unknown, a constant, or a
+ * symbol naming the value some op produced the last time it ran. Two locations with the same
+ * id hold the same value, so a load of a value that is already in place can go, and an
+ * immediate that some register already holds can be read from that register instead.
+ */
+using ValueId = uint64_t;
+
+constexpr ValueId UNKNOWN_VALUE = 0;
+constexpr ValueId SYMBOL_BASE = 0x10001;
+constexpr size_t TRACKED = 8; // a, b, c, acc, flgs, lgc, numbr, mar in Locations bit order
+constexpr size_t RAM_CELLS = 16; // known ram cells kept per state
+
+enum SymbolSlots {
+    SLOT_BUS,
+    SLOT_MAR,
+    SLOT_ACC,
+    SLOT_FLGS,
+    SLOT_LGC,
+    SLOT_COUNT
+};
+
+static ValueId constant(const uint16_t value) {
+    return static_cast<ValueId>(value) + 1;
+}
+
+static bool is_constant(const ValueId id) {
+    return id != UNKNOWN_VALUE && id < SYMBOL_BASE;
+}
+
+static uint16_t constant_value(const ValueId id) {
+    return static_cast<uint16_t>(id - 1);
+}
+
+static ValueId symbol(const size_t op, const size_t slot) {
+    return SYMBOL_BASE + op * SLOT_COUNT + slot;
+}
+
+static size_t slot_of(const uint16_t location) {
+    size_t slot = 0;
+
+    while (!(location & (1 << slot))) {
+        ++slot;
+    }
+
+    return slot;
+}
+
+// registers an immediate can be replaced with, in order of preference
+static const uint16_t readable[] = { LOC_A, LOC_B, LOC_C, LOC_ACC, LOC_FLGS, LOC_LGC };
+
+static uint16_t to_bus_code(const uint16_t location) {
+    switch (location) {
+        case(LOC_A):
+            return A_TO_BUS;
+        case(LOC_B):
+            return B_TO_BUS;
+        case(LOC_C):
+            return C_TO_BUS;
+        case(LOC_ACC):
+            return ACC_TO_BUS;
+        case(LOC_FLGS):
+            return FLGS_TO_BUS;
+        default:
+            return LGC_TO_BUS;
+    }
+}
+
+struct ValueState {
+    bool reached_ = false;
+    std::array<ValueId, TRACKED> regs_ {};
+
+    // ram address value id to contents value id
+    std::vector<std::pair<ValueId, ValueId>> ram_;
+
+    ValueId& reg(const uint16_t location) {
+        return regs_[slot_of(location)];
+    }
+
+    const ValueId* cell(const ValueId address) const {
+        for (const auto& [key, value] : ram_) {
+            if (key == address) {
+                return &value;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void join(const ValueState& other) {
+        if (!other.reached_) {
+            return;
+        }
+
+        if (!reached_) {
+            *this = other;
+            return;
+        }
+
+        for (size_t i = 0; i < TRACKED; ++i) {
+            if (regs_[i] != other.regs_[i]) {
+                regs_[i] = UNKNOWN_VALUE;
+            }
+        }
+
+        std::erase_if(ram_, [&](const std::pair<ValueId, ValueId>& entry) {
+            const ValueId* value = other.cell(entry.first);
+            return value == nullptr || *value != entry.second;
+        });
+    }
+
+    bool operator==(const ValueState& other) const {
+        return reached_ == other.reached_ && regs_ == other.regs_ && ram_ == other.ram_;
+    }
+};
+
+// value the op puts on the bus, unknown when it can not be named without running the op
+static ValueId bus_value(const ValueState& state, const MicroOp& op) {
+    if (op.has_imm_) {
+        return constant(op.imm_);
+    }
+
+    const uint16_t src = word_src(op.word_);
+
+    if (src == BUS_RAM) {
+        const ValueId address = state.regs_[slot_of(LOC_MAR)];
+        const ValueId* value = address == UNKNOWN_VALUE ? nullptr : state.cell(address);
+
+        return value == nullptr ? UNKNOWN_VALUE : *value;
+    }
+
+    const uint16_t location = source_location(src);
+
+    return location == 0 ? UNKNOWN_VALUE : state.regs_[slot_of(location)];
+}
+
+static void step(ValueState& state, const MicroOp& op, const size_t index) {
+    // values this op made on an earlier run are stale once it runs again
+    const ValueId first = symbol(index, 0);
+    const ValueId last = symbol(index, SLOT_COUNT - 1);
+
+    auto stale = [&](const ValueId id) {
+        return id >= first && id <= last;
+    };
+
+    for (ValueId& id : state.regs_) {
+        if (stale(id)) {
+            id = UNKNOWN_VALUE;
+        }
+    }
+
+    std::erase_if(state.ram_, [&](const std::pair<ValueId, ValueId>& entry) {
+        return stale(entry.first) || stale(entry.second);
+    });
+
+    if (is_exec(op) || !is_known(op)) {
+        state.regs_.fill(UNKNOWN_VALUE);
+        state.ram_.clear();
+        return;
+    }
+
+    if (is_halt(op) || is_jump(op)) {
+        return;
+    }
+
+    const uint16_t src = word_src(op.word_);
+    ValueId& mar = state.reg(LOC_MAR);
+
+    if ((src == BUS_RAM || word_alu(op.word_) == ALU_RAM_WR) && mar == UNKNOWN_VALUE) {
+        mar = symbol(index, SLOT_MAR);
+    }
+
+    ValueId value = bus_value(state, op);
+
+    if (value == UNKNOWN_VALUE) {
+        value = symbol(index, SLOT_BUS);
+
+        // the source now holds the named value too
+        if (src == BUS_RAM) {
+            state.ram_.insert(state.ram_.begin(), { mar, value });
+        } else if (source_location(src) != 0) {
+            state.reg(source_location(src)) = value;
+        }
+    }
+
+    switch (word_alu(op.word_)) {
+        case(ALU_ADD):
+        case(ALU_SUB):
+        case(ALU_CMP): {
+            const ValueId numbr = state.reg(LOC_NUMBR);
+
+            if (is_constant(numbr) && is_constant(value)) {
+                const AluResult result = alu_result(word_alu(op.word_), constant_value(numbr), constant_value(value));
+
+                state.reg(LOC_ACC) = constant(result.acc_);
+                state.reg(LOC_FLGS) = constant(result.flgs_);
+                state.reg(LOC_LGC) = constant(result.lgc_);
+            } else {
+                state.reg(LOC_ACC) = symbol(index, SLOT_ACC);
+                state.reg(LOC_FLGS) = symbol(index, SLOT_FLGS);
+                state.reg(LOC_LGC) = symbol(index, SLOT_LGC);
+            }
+
+            break;
+        }
+        case(ALU_RAM_WR):
+            // a write through a symbolic address may alias any cell
+            if (is_constant(mar)) {
+                std::erase_if(state.ram_, [&](const std::pair<ValueId, ValueId>& entry) {
+                    return entry.first == mar || !is_constant(entry.first);
+                });
+            } else {
+                state.ram_.clear();
+            }
+
+            state.ram_.insert(state.ram_.begin(), { mar, value });
+            break;
+        default:
+            state.reg(dest_location(word_dest(op.word_))) = value;
+            break;
+    }
+
+    if (state.ram_.size() > RAM_CELLS) {
+        state.ram_.resize(RAM_CELLS);
+    }
+}
+
+// fills in the state on entry to every block, false when the values do not settle
+static bool solve_values(const std::vector<MicroOp>& ops, const std::vector<BasicBlock>& blocks, std::vector<ValueState>& in) {
+    in.assign(blocks.size(), ValueState());
+    std::vector<ValueState> out(blocks.size());
+
+    bool changed = true;
+    size_t rounds = 0;
+
+    while (changed) {
+        changed = false;
+
+        // lattice is finite but keep an upper bound, giving up leaves the code as it is
+        if (++rounds > blocks.size() + 64) {
+            return false;
+        }
+
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            ValueState state;
+
+            // nothing is known on entry, so jumps back to the start can not add anything
+            if (b == 0) {
+                state.reached_ = true;
+            } else {
+                for (const size_t pred : blocks[b].predecessors_) {
+                    state.join(out[pred]);
+                }
+            }
+
+            if (!state.reached_) {
+                continue;
+            }
+
+            in[b] = state;
+
+            for (size_t i = blocks[b].first_; i <= blocks[b].last_; ++i) {
+                if (!ops[i].removed_) {
+                    step(state, ops[i], i);
+                }
+            }
+
+            if (!(state == out[b])) {
+                out[b] = state;
+                changed = true;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool Optimizer::track_values() {
+    if (!relocatable_ || ops_.empty()) {
+        return false;
+    }
+
+    build_blocks();
+
+    std::vector<ValueState> in;
+
+    if (!solve_values(ops_, blocks_, in)) {
+        return false;
+    }
+
+    uint32_t removed = 0;
+    uint32_t shortened = 0;
+
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        ValueState state = in[b];
+
+        if (!state.reached_) {
+            continue;
+        }
+
+        for (size_t i = blocks_[b].first_; i <= blocks_[b].last_; ++i) {
+            MicroOp& op = ops_[i];
+
+            if (op.removed_) {
+                continue;
+            }
+
+            const ValueId value = bus_value(state, op);
+            const uint16_t alu = word_alu(op.word_);
+            const bool alu_op = alu == ALU_ADD || alu == ALU_SUB || alu == ALU_CMP;
+
+            if (is_move(op) && value != UNKNOWN_VALUE && state.reg(dest_location(word_dest(op.word_))) == value) {
+                op.removed_ = true;
+                ++removed;
+                continue;
+            }
+
+            if (alu == ALU_RAM_WR && is_known(op) && value != UNKNOWN_VALUE) {
+                const ValueId mar = state.reg(LOC_MAR);
+                const ValueId* cell = mar == UNKNOWN_VALUE ? nullptr : state.cell(mar);
+
+                if (cell != nullptr && *cell == value) {
+                    op.removed_ = true;
+                    ++removed;
+                    continue;
+                }
+            }
+
+            // read an immediate (or a ram cell) from a register that already holds it
+            const bool from_ram = !op.has_imm_ && word_src(op.word_) == BUS_RAM;
+
+            if ((is_move(op) || alu_op) && (op.has_imm_ || from_ram) && value != UNKNOWN_VALUE) {
+                for (const uint16_t location : readable) {
+                    if (state.reg(location) == value) {
+                        op.word_ = make_word(alu, word_dest(op.word_), to_bus_code(location), FLAG_NONE);
+                        op.has_imm_ = false;
+                        op.imm_ = 0;
+                        ++shortened;
+                        break;
+                    }
+                }
+            }
+
+            step(state, op, i);
+        }
+    }
+
+    count("known value", removed);
+    count("immediate from register", shortened);
+
+    return removed + shortened > 0;
+}
+
+static bool is_alu(const MicroOp& op) {
+    const uint16_t alu = word_alu(op.word_);
+    return is_known(op) && (alu == ALU_ADD || alu == ALU_SUB || alu == ALU_CMP);
+}
+
+// ops that only load something, so they can go when nothing reads what they load
+static bool removable(const MicroOp& op) {
+    return is_move(op) || is_alu(op);
+}
+
+/*
+ * Backward liveness over the blocks, giving what is live when each block is left. Removable
+ * ops whose results are dead do not make their inputs live. exit_live is what is live where
+ * the program stops.
+ */
+static std::vector<uint16_t> solve_liveness(const std::vector<MicroOp>& ops, const std::vector<BasicBlock>& blocks, const uint16_t exit_live) {
+    std::vector<uint16_t> live_in(blocks.size(), 0);
+    std::vector<uint16_t> live_out(blocks.size(), 0);
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (size_t b = blocks.size(); b-- > 0;) {
+            uint16_t live = blocks[b].exits_ ? exit_live : 0;
+
+            for (const size_t succ : blocks[b].successors_) {
+                live |= live_in[succ];
+            }
+
+            live_out[b] = live;
+
+            for (size_t i = blocks[b].last_ + 1; i-- > blocks[b].first_;) {
+                const MicroOp& op = ops[i];
+
+                if (op.removed_ || (removable(op) && !(writes(op) & live))) {
+                    continue;
+                }
+
+                live = (live & ~writes(op)) | reads(op);
+            }
+
+            if (live != live_in[b]) {
+                live_in[b] = live;
+                changed = true;
+            }
+        }
+    }
+
+    return live_out;
+}
+
+/*
+ * A load or alu op whose results are all overwritten before anything reads them is removed.
+ * Everything is live where the program stops, since the final registers and ram are what the
+ * program leaves behind.
+ */
+bool Optimizer::remove_dead_loads() {
+    if (!relocatable_ || ops_.empty()) {
+        return false;
+    }
+
+    build_blocks();
+
+    const std::vector<uint16_t> live_out = solve_liveness(ops_, blocks_, LOC_ALL);
+    uint32_t removed = 0;
+
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        uint16_t live = live_out[b];
+
+        for (size_t i = blocks_[b].last_ + 1; i-- > blocks_[b].first_;) {
+            MicroOp& op = ops_[i];
+
+            if (op.removed_) {
+                continue;
+            }
+
+            if (removable(op) && !(writes(op) & live)) {
+                op.removed_ = true;
+                ++removed;
+                continue;
+            }
+
+            live = (live & ~writes(op)) | reads(op);
+        }
+    }
+
+    count("dead load", removed);
+
+    return removed > 0;
+}
+
+static const char* alu_name(const uint16_t alu) {
+    switch (alu) {
+        case(ALU_ADD):
+            return "add";
+        case(ALU_SUB):
+            return "sub";
+        default:
+            return "cmp";
+    }
+}
+
+/*
+ * Constant folding. An alu op with both operands known has a known acc, flgs and lgc, so a
+ * je/jne depending on it always goes the same way and a later read of acc, flgs or lgc can
+ * take the value as an immediate instead. Once nothing reads the results the op goes and its
+ * numbr load is left to the dead load pass. Results that are only left behind when the program
+ * stops do not keep the op alive, but that fold is reported since the final registers change.
+ */
+bool Optimizer::fold_constants() {
+    if (!relocatable_ || ops_.empty()) {
+        return false;
+    }
+
+    build_blocks();
+
+    std::vector<ValueState> in;
+
+    if (!solve_values(ops_, blocks_, in)) {
+        return false;
+    }
+
+    uint32_t branches = 0;
+
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        ValueState state = in[b];
+
+        if (!state.reached_) {
+            continue;
+        }
+
+        for (size_t i = blocks_[b].first_; i <= blocks_[b].last_; ++i) {
+            MicroOp& op = ops_[i];
+
+            if (op.removed_) {
+                continue;
+            }
+
+            const uint16_t dest = word_dest(op.word_);
+            const ValueId lgc = state.reg(LOC_LGC);
+
+            if (is_jump(op) && op.has_imm_ && dest != BUS_PC && is_constant(lgc)) {
+                const bool taken = (dest == BUS_JE) == ((constant_value(lgc) & LGC_EQUAL) != 0);
+
+                if (taken) {
+                    op.word_ = make_word(ALU_NONE, BUS_PC, word_src(op.word_), word_flags(op.word_));
+                } else {
+                    op.removed_ = true;
+                }
+
+                ++branches;
+                continue;
+            }
+
+            step(state, op, i);
+        }
+    }
+
+    // resolved branches change the edges, so values and liveness are worked out again
+    if (branches > 0) {
+        build_blocks();
+
+        if (!solve_values(ops_, blocks_, in)) {
+            count("branch fold", branches);
+            return true;
+        }
+    }
+
+    constexpr uint16_t results = LOC_ACC | LOC_FLGS | LOC_LGC;
+
+    const std::vector<uint16_t> live_out = solve_liveness(ops_, blocks_, LOC_ALL & ~results);
+    const std::vector<uint16_t> final_out = solve_liveness(ops_, blocks_, LOC_ALL);
+
+    // rewrites the reads of op index's results into immediates and removes it, when that pays
+    auto fold = [&](const size_t b, const size_t index, const AluResult& result) {
+        std::vector<size_t> readers;
+        uint16_t pending = results;
+
+        for (size_t j = index + 1; j <= blocks_[b].last_ && pending != 0; ++j) {
+            const MicroOp& op = ops_[j];
+
+            if (op.removed_) {
+                continue;
+            }
+
+            // only a bus read can become an immediate, wr and je/jne have no such form
+            if (reads(op) & results) {
+                if (op.has_imm_ || !(is_move(op) || is_alu(op))) {
+                    return false;
+                }
+
+                readers.push_back(j);
+            }
+
+            pending &= ~writes(op);
+        }
+
+        // every rewritten read grows by a word, the folded op gives back its own
+        if ((live_out[b] & pending) || readers.size() > ops_[index].size()) {
+            return false;
+        }
+
+        for (const size_t j : readers) {
+            MicroOp& op = ops_[j];
+            const uint16_t location = source_location(word_src(op.word_));
+
+            op.imm_ = location == LOC_ACC ? result.acc_ : (location == LOC_FLGS ? result.flgs_ : result.lgc_);
+            op.has_imm_ = true;
+            op.word_ = make_word(word_alu(op.word_), word_dest(op.word_), BUS_NONE, FLAG_IMM);
+        }
+
+        MicroOp& op = ops_[index];
+        op.removed_ = true;
+
+        if (final_out[b] & pending) {
+            stats_.notes_.push_back("line " + std::to_string(op.line_) + ": folded " + alu_name(word_alu(op.word_))
+                + " no longer sets the acc, flgs and lgc left when the program stops");
+        }
+
+        return true;
+    };
+
+    uint32_t folded = 0;
+
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        ValueState state = in[b];
+
+        if (!state.reached_) {
+            continue;
+        }
+
+        for (size_t i = blocks_[b].first_; i <= blocks_[b].last_; ++i) {
+            const MicroOp& op = ops_[i];
+
+            if (op.removed_) {
+                continue;
+            }
+
+            const ValueId numbr = state.reg(LOC_NUMBR);
+            const ValueId value = bus_value(state, op);
+
+            // nothing reads the results any more, so the state does not need them
+            if (is_alu(op) && is_constant(numbr) && is_constant(value)
+                && fold(b, i, alu_result(word_alu(op.word_), constant_value(numbr), constant_value(value)))) {
+                ++folded;
+                continue;
+            }
+
+            step(state, op, i);
+        }
+    }
+
+    count("branch fold", branches);
+    count("constant fold", folded);
+
+    return branches + folded > 0;
+}
+
+// blocks that can not be reached from the start of the program
+bool Optimizer::remove_unreachable() {
+    if (!relocatable_ || ops_.empty()) {
+        return false;
+    }
+
+    build_blocks();
+
+    std::vector<bool> reached(blocks_.size(), false);
+    std::vector<size_t> pending = { 0 };
+    reached[0] = true;
+
+    while (!pending.empty()) {
+        const size_t b = pending.back();
+        pending.pop_back();
+
+        for (const size_t succ : blocks_[b].successors_) {
+            if (!reached[succ]) {
+                reached[succ] = true;
+                pending.push_back(succ);
+            }
+        }
+    }
+
+    uint32_t removed = 0;
+
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        if (reached[b]) {
+            continue;
+        }
+
+        for (size_t i = blocks_[b].first_; i <= blocks_[b].last_; ++i) {
+            if (!ops_[i].removed_) {
+                ops_[i].removed_ = true;
+                ++removed;
+            }
+        }
+    }
+
+    count("unreachable", removed);
+
+    return removed > 0;
+}
+
+/*
+ * Jump threading: a jump landing on a jmp goes straight to where that jmp goes, and a jmp
+ * landing on hlt becomes the hlt itself.
+ */
+bool Optimizer::thread_jumps() {
+    if (!relocatable_) {
+        return false;
+    }
+
+    auto is_jmp = [](const MicroOp& op) {
+        return is_jump(op) && op.has_imm_ && word_dest(op.word_) == BUS_PC;
+    };
+
+    uint32_t threaded = 0;
+
+    for (MicroOp& op : ops_) {
+        if (op.removed_ || !is_jump(op) || op.target_ < 0) {
+            continue;
+        }
+
+        // a chain can loop back on itself, the hop limit stops it anywhere along the loop
+        for (size_t hops = 0; hops < ops_.size(); ++hops) {
+            const size_t target = next_live(op.target_);
+
+            if (target >= ops_.size() || !is_jmp(ops_[target]) || &ops_[target] == &op) {
+                break;
+            }
+
+            const MicroOp& next = ops_[target];
+
+            if (next.target_ >= 0 && next_live(next.target_) == target) {
+                break;
+            }
+
+            op.target_ = next.target_;
+            op.imm_ = next.imm_;
+            ++threaded;
+
+            if (op.target_ < 0) {
+                break;
+            }
+        }
+
+        if (is_jmp(op) && op.target_ >= 0) {
+            const size_t target = next_live(op.target_);
+
+            if (target < ops_.size() && is_halt(ops_[target])) {
+                op.word_ = ops_[target].word_;
+                op.has_imm_ = false;
+                op.imm_ = 0;
+                op.target_ = -1;
+                ++threaded;
+            }
+        }
+    }
+
+    count("jump thread", threaded);
+
+    return threaded > 0;
+}
+
+// immediate of a loop moved into a register loaded in front of it
+struct Optimizer::HoistPlan {
+    size_t header_; // first op of the loop
+    const NaturalLoop* loop_;
+
+    uint16_t from_bus_;
+    uint16_t to_bus_;
+    const char* register_;
+
+    // an immediate jump target (the op it lands on) or a plain value, the same key means the same word after relocation
+    std::pair<bool, uint64_t> key_;
+    uint32_t uses_;
+
+    // fewest and most rewritten words one iteration runs
+    std::pair<uint32_t, uint32_t> saved_;
+};
+
+static bool hoistable(const MicroOp& op) {
+    return !op.removed_ && op.has_imm_ && is_known(op) && word_src(op.word_) == BUS_NONE && (!is_jump(op) || op.target_ >= 0);
+}
+
+static std::pair<bool, uint64_t> hoist_key(const std::vector<MicroOp>& ops, const MicroOp& op) {
+    if (op.target_ < 0) {
+        return { false, op.imm_ };
+    }
+
+    size_t target = op.target_;
+
+    while (target < ops.size() && ops[target].removed_) {
+        ++target;
+    }
+
+    return { true, target };
+}
+
+// fewest and most of weight one iteration of the loop runs into, from the start of the header to the end of a latch
+static std::pair<uint32_t, uint32_t> per_iteration(const std::vector<BasicBlock>& blocks, const std::vector<size_t>& order, const std::vector<size_t>& position, const NaturalLoop& loop, const std::vector<uint32_t>& weight) {
+    std::unordered_map<size_t, std::pair<uint32_t, uint32_t>> reach;
+    reach[loop.header_] = { weight[loop.header_], weight[loop.header_] };
+
+    // forward edges only, so an inner loop is counted once
+    for (size_t i = position[loop.header_]; i < order.size(); ++i) {
+        const auto from = reach.find(order[i]);
+
+        if (from == reach.end()) {
+            continue;
+        }
+
+        const std::pair<uint32_t, uint32_t> through = from->second;
+
+        for (const size_t successor : blocks[order[i]].successors_) {
+            if (position[successor] <= i || !loop.contains(successor)) {
+                continue;
+            }
+
+            const uint32_t best = through.first + weight[successor];
+            const uint32_t worst = through.second + weight[successor];
+            const auto [to, inserted] = reach.try_emplace(successor, best, worst);
+
+            if (!inserted) {
+                to->second = { std::min(to->second.first, best), std::max(to->second.second, worst) };
+            }
+        }
+    }
+
+    std::pair<uint32_t, uint32_t> range { UINT32_MAX, 0 };
+
+    for (const size_t latch : loop.latches_) {
+        const auto end = reach.find(latch);
+
+        if (end != reach.end()) {
+            range.first = std::min(range.first, end->second.first);
+            range.second = std::max(range.second, end->second.second);
+        }
+    }
+
+    return range.first == UINT32_MAX ? std::make_pair(0u, 0u) : range;
+}
+
+bool Optimizer::plan_hoist(const NaturalLoop& loop, const std::vector<uint16_t>& live_out, const std::vector<bool>& register_target, HoistPlan& plan) const {
+    struct FreeRegister {
+        uint16_t location_;
+        uint16_t from_bus_;
+        uint16_t to_bus_;
+        const char* name_;
+    };
+
+    // c first, programs tend to leave it for last
+    constexpr FreeRegister registers[] = {
+        { LOC_C, C_FROM_BUS, C_TO_BUS, "c" },
+        { LOC_B, B_FROM_BUS, B_TO_BUS, "b" },
+        { LOC_A, A_FROM_BUS, A_TO_BUS, "a" },
+    };
+
+    const size_t header = blocks_[loop.header_].first_;
+
+    // the load goes right before the header, so nothing in the loop may fall through into it and jumps from outside must be retargetable
+    if (register_target[header]) {
+        return false;
+    }
+
+    for (size_t previous = header; previous-- > 0;) {
+        if (ops_[previous].removed_) {
+            continue;
+        }
+
+        if (loop.contains(block_of(previous))) {
+            return false;
+        }
+
+        break;
+    }
+
+    uint16_t used = 0;
+    std::vector<std::pair<std::pair<bool, uint64_t>, uint32_t>> uses;
+
+    for (const size_t block : loop.blocks_) {
+        used |= live_out[block];
+
+        for (size_t i = blocks_[block].first_; i <= blocks_[block].last_; ++i) {
+            const MicroOp& op = ops_[i];
+
+            if (op.removed_) {
+                continue;
+            }
+
+            used |= reads(op) | writes(op);
+
+            if (!hoistable(op)) {
+                continue;
+            }
+
+            const std::pair<bool, uint64_t> key = hoist_key(ops_, op);
+            auto use = std::find_if(uses.begin(), uses.end(), [&](const auto& candidate) { return candidate.first == key; });
+
+            if (use == uses.end()) {
+                uses.push_back({ key, 1 });
+            } else {
+                ++use->second;
+            }
+        }
+    }
+
+    // the register must be untouched by the loop and dead wherever the loop can go, so its old value is never needed
+    const FreeRegister* free = nullptr;
+
+    for (const FreeRegister& candidate : registers) {
+        if (!(used & candidate.location_)) {
+            free = &candidate;
+            break;
+        }
+    }
+
+    if (free == nullptr || uses.empty()) {
+        return false;
+    }
+
+    // on a tie the jump target goes, a loop always takes its back edge
+    const auto best = std::max_element(uses.begin(), uses.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second < b.second : a.first.first < b.first.first;
+    });
+
+    plan = HoistPlan { header, &loop, free->from_bus_, free->to_bus_, free->name_, best->first, best->second, {} };
+
+    return true;
+}
+
+void Optimizer::apply_hoists(const std::vector<HoistPlan>& plans, const std::vector<int64_t>& owner) {
+    // plan whose load goes in front of each op, and how far each op moves down
+    std::vector<int64_t> plan_at(ops_.size() + 1, -1);
+    std::vector<size_t> shift(ops_.size() + 1, 0);
+
+    for (size_t p = 0; p < plans.size(); ++p) {
+        plan_at[plans[p].header_] = static_cast<int64_t>(p);
+    }
+
+    for (size_t i = 0, loads = 0; i <= ops_.size(); ++i) {
+        loads += plan_at[i] >= 0;
+        shift[i] = loads;
+    }
+
+    // jumps that land on a header from outside its loop land on the load in front of it
+    auto relocate = [&](const int64_t target, const int64_t from_plan) -> int64_t {
+        if (target < 0) {
+            return target;
+        }
+
+        size_t landing = target;
+
+        while (landing < ops_.size() && ops_[landing].removed_) {
+            ++landing;
+        }
+
+        if (landing < ops_.size() && plan_at[landing] >= 0) {
+            return landing + shift[landing] - (plan_at[landing] == from_plan ? 0 : 1);
+        }
+
+        return target + shift[target];
+    };
+
+    std::vector<MicroOp> ops;
+    ops.reserve(ops_.size() + plans.size());
+
+    std::vector<uint32_t> rewritten(plans.size(), 0);
+
+    for (size_t i = 0; i < ops_.size(); ++i) {
+        if (plan_at[i] >= 0) {
+            const HoistPlan& plan = plans[plan_at[i]];
+
+            MicroOp load;
+            load.word_ = make_word(ALU_NONE, plan.from_bus_, BUS_NONE, FLAG_IMM);
+            load.has_imm_ = true;
+            load.imm_ = plan.key_.first ? 0 : static_cast<Word>(plan.key_.second);
+            load.target_ = plan.key_.first ? relocate(static_cast<int64_t>(plan.key_.second), plan_at[i]) : -1;
+            load.line_ = ops_[i].line_;
+            load.address_ = ops_[i].address_;
+
+            // the load runs once on entry, so it is mapped to the line before the loop rather than the header, whose runs count iterations
+            for (size_t previous = i; previous-- > 0;) {
+                if (!ops_[previous].removed_) {
+                    load.line_ = ops_[previous].line_;
+                    break;
+                }
+            }
+
+            ops.push_back(load);
+        }
+
+        MicroOp op = ops_[i];
+
+        if (owner[i] >= 0 && hoistable(op) && hoist_key(ops_, op) == plans[owner[i]].key_) {
+            op.word_ = make_word(word_alu(op.word_), word_dest(op.word_), plans[owner[i]].to_bus_, FLAG_NONE);
+            op.has_imm_ = false;
+            ++rewritten[owner[i]];
+        }
+
+        op.target_ = relocate(op.target_, owner[i]);
+        ops.push_back(op);
+    }
+
+    for (size_t p = 0; p < plans.size(); ++p) {
+        const HoistPlan& plan = plans[p];
+
+        char value[32];
+        snprintf(value, sizeof(value), "0x%04X", static_cast<unsigned>(plan.key_.second));
+
+        const std::string loaded = plan.key_.first ? "the address of line " + std::to_string(ops_[plan.key_.second].line_) : value;
+        const auto [best, worst] = plan.saved_;
+        const std::string cycles = best == worst ? std::to_string(worst) : std::to_string(best) + "-" + std::to_string(worst);
+
+        stats_.hoisted_.push_back("loop at line " + std::to_string(ops_[plan.header_].line_) + ": " + loaded + " loaded into " + plan.register_
+            + " before the loop, " + std::to_string(rewritten[p]) + (rewritten[p] == 1 ? " word" : " words") + " shorter, " + cycles
+            + (worst == 1 ? " cycle" : " cycles") + " saved per iteration for 2 more on entry");
+
+        count("loop invariant", rewritten[p]);
+    }
+
+    ops_ = std::move(ops);
+}
+
+size_t Optimizer::block_of(const size_t op) const {
+    // blocks_ is in op order
+    const auto block = std::upper_bound(blocks_.begin(), blocks_.end(), op, [](size_t index, const BasicBlock& candidate) {
+        return index < candidate.first_;
+    });
+
+    return block - blocks_.begin() - 1;
+}
+
+/*
+ * An immediate a loop reads each time round (a jump target, a wr/rd address or a constant) is
+ * loaded once into a register the loop never touches, in front of the loop, and the ops in the
+ * loop take the register instead: one word and one cycle less each time they run. The register
+ * must also be dead everywhere the loop can go, which holds for loops that never exit or that
+ * are followed by code overwriting it. Each round hoists one value out of every loop that does
+ * not hold another loop hoisted from in the same round, so inner loops go first, and a loop
+ * can take one value in each free register.
+ */
+bool Optimizer::hoist_invariants() {
+    if (!relocatable_ || ops_.empty()) {
+        return false;
+    }
+
+    bool hoisted = false;
+
+    for (;;) {
+        build_blocks();
+
+        const std::vector<NaturalLoop> loops = find_loops(blocks_);
+        const std::vector<uint16_t> live_out = solve_liveness(ops_, blocks_, LOC_ALL);
+        const std::vector<size_t> order = reverse_postorder(blocks_);
+
+        std::vector<size_t> position(blocks_.size(), SIZE_MAX);
+
+        for (size_t i = 0; i < order.size(); ++i) {
+            position[order[i]] = i;
+        }
+
+        // headers a register jump lands on, a load in front of them would be skipped
+        std::vector<bool> register_target(ops_.size() + 1, false);
+
+        for (const MicroOp& op : ops_) {
+            if (!op.removed_ && is_jump(op) && !op.has_imm_ && op.target_ >= 0) {
+                register_target[hoist_key(ops_, op).second] = true;
+            }
+        }
+
+        std::vector<HoistPlan> plans;
+        std::vector<int64_t> owner(ops_.size(), -1);
+        std::vector<bool> claimed(blocks_.size(), false);
+        std::vector<uint32_t> weight(blocks_.size(), 0);
+
+        for (size_t l = loops.size(); l-- > 0;) {
+            const NaturalLoop& loop = loops[l];
+            HoistPlan plan;
+
+            if (std::any_of(loop.blocks_.begin(), loop.blocks_.end(), [&](size_t block) { return claimed[block]; })) {
+                continue;
+            }
+
+            if (!plan_hoist(loop, live_out, register_target, plan)) {
+                continue;
+            }
+
+            for (const size_t block : loop.blocks_) {
+                claimed[block] = true;
+                weight[block] = 0;
+
+                for (size_t i = blocks_[block].first_; i <= blocks_[block].last_; ++i) {
+                    owner[i] = static_cast<int64_t>(plans.size());
+
+                    if (hoistable(ops_[i]) && hoist_key(ops_, ops_[i]) == plan.key_) {
+                        ++weight[block];
+                    }
+                }
+            }
+
+            plan.saved_ = per_iteration(blocks_, order, position, loop, weight);
+            plans.push_back(plan);
+        }
+
+        if (plans.empty()) {
+            break;
+        }
+
+        apply_hoists(plans, owner);
+        hoisted = true;
+    }
+
+    return hoisted;
+}
+
+void Optimizer::run() {
+    if (!relocatable_) {
+        return;
+    }
+
+    bool changed = true;
+
+    while (changed) {
+        changed = track_values();
+        changed = fold_constants() || changed;
+        changed = remove_dead_loads() || changed;
+        changed = peephole() || changed;
+        changed = thread_jumps() || changed;
+        changed = remove_unreachable() || changed;
+    }
+
+    hoist_invariants();
+}
+
+void Optimizer::emit(std::vector<Word>& words, LineMap& map) {
+    if (!relocatable_) {
+        stats_.words_after_ = stats_.words_before_;
+        return;
+    }
+
+    // removed ops take the address of the next op that survives
+    std::vector<uint32_t> addresses(ops_.size() + 1);
+    uint32_t address = 0;
+
+    for (size_t i = 0; i < ops_.size(); ++i) {
+        addresses[i] = address;
+
+        if (!ops_[i].removed_) {
+            address += ops_[i].size();
+        }
+    }
+
+    addresses[ops_.size()] = address;
+
+    const uint32_t removed = stats_.words_before_ - address;
+
+    words.clear();
+    words.reserve(address);
+    map.entries_.clear();
+
+    // an entry whose first op was removed starts at the next op that survives
+    bool starts_entry = false;
+
+    for (const MicroOp& op : ops_) {
+        starts_entry = starts_entry || op.starts_entry_;
+
+        if (op.removed_) {
+            continue;
+        }
+
+        const uint32_t at = static_cast<uint32_t>(words.size());
+        words.push_back(op.word_);
+
+        if (op.has_imm_) {
+            Word imm = op.imm_;
+
+            if (op.target_ >= 0) {
+                imm = static_cast<Word>(addresses[op.target_]);
+            } else if (is_jump(op) && imm >= stats_.words_before_) {
+                // past the end of the program stays past the end
+                imm = static_cast<Word>(imm - removed);
+            }
+
+            words.push_back(imm);
+        } else if (is_jump(op) && op.target_ >= 0) {
+            stats_.register_jumps_.push_back({ at, addresses[op.target_] });
+        }
+
+        if (!starts_entry && !map.entries_.empty() && map.entries_.back().line_ == op.line_ && map.entries_.back().address_ + map.entries_.back().words_ == at) {
+            map.entries_.back().words_ += op.size();
+        } else {
+            map.entries_.push_back({ at, op.size(), op.line_ });
+        }
+
+        starts_entry = false;
+    }
+
+    stats_.words_after_ = static_cast<uint32_t>(words.size());
+}
+
+void Optimizer::report(const OptimizerStats& stats, std::ostream& out) {
+    if (!stats.skipped_.empty()) {
+        out << "optimizer: skipped, " << stats.skipped_ << '\n';
+        return;
+    }
+
+    const uint32_t saved = stats.words_before_ - stats.words_after_;
+
+    out << "optimizer: " << stats.words_before_ << " -> " << stats.words_after_ << " words, saved "
+        << saved << " words and " << saved << " cycles per run through the rewritten code" << '\n';
+
+    for (const auto& [name, rewrites] : stats.rewrites_) {
+        if (rewrites == 0) {
+            continue;
+        }
+
+        out << "  " << name << ": " << rewrites << '\n';
+    }
+
+    for (const std::string& loop : stats.hoisted_) {
+        out << "  " << loop << '\n';
+    }
+
+    for (const std::string& note : stats.notes_) {
+        out << "  " << note << '\n';
+    }
+}
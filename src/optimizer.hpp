@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "isa.hpp"
+#include "linemap.hpp"
+
+// one control word and the immediate that follows it, the unit the optimizer works on
+struct MicroOp {
+    Word word_ = 0;
+    Word imm_ = 0;
+    bool has_imm_ = false;
+
+    uint32_t line_ = 0;
+    uint32_t address_ = 0; // address before optimizing
+
+    // index of the op an immediate jump lands on, -1 for anything else
+    int64_t target_ = -1;
+
+    // a jump lands here (or execution starts here), so the op starts a basic block
+    bool is_target_ = false;
+    bool removed_ = false;
+
+    // first op of a line map entry, macro and .rep copies of a line keep an entry each
+    bool starts_entry_ = false;
+
+    uint32_t size() const {
+        return has_imm_ ? 2 : 1;
+    }
+};
+
+// straight run of live ops, entered only at first_ and left only after last_
+struct BasicBlock {
+    size_t first_;
+    size_t last_;
+
+    std::vector<size_t> successors_;
+    std::vector<size_t> predecessors_;
+
+    // control can leave the program from here (hlt, the end of rom or a jump past it)
+    bool exits_ = false;
+};
+
+// blocks entered through header_ that can run again by jumping back to it from one of latches_
+struct NaturalLoop {
+    size_t header_;
+
+    // sorted, header_ included
+    std::vector<size_t> blocks_;
+    std::vector<size_t> latches_;
+
+    // innermost loop holding this one, -1 for an outermost loop
+    int64_t parent_ = -1;
+    uint32_t depth_ = 1;
+
+    bool contains(size_t block) const;
+};
+
+// blocks reachable from the first block, each one after everything that reaches it other than through a back edge
+std::vector<size_t> reverse_postorder(const std::vector<BasicBlock>& blocks);
+
+// loops of the blocks reachable from the first block, outer loops before the loops inside them
+std::vector<NaturalLoop> find_loops(const std::vector<BasicBlock>& blocks);
+
+struct OptimizerStats {
+    uint32_t words_before_ = 0;
+    uint32_t words_after_ = 0;
+
+    // number of rewrites made by each pattern, in table order
+    std::vector<std::pair<std::string, uint32_t>> rewrites_;
+
+    std::string skipped_;
+
+    // folds that change what the program leaves in acc, flgs and lgc
+    std::vector<std::string> notes_;
+
+    // immediates moved out of a loop into a register, with the cycles each iteration saves
+    std::vector<std::string> hoisted_;
+
+    // jumps hoisting left reading their target from a register: address of the jump and of where it lands
+    std::vector<std::pair<uint32_t, uint32_t>> register_jumps_;
+};
+
+/*
+ * Rewrites the encoded control words between parse_tree and write_file. Rewrites remove words
+ * whose effect is already in place, code nothing can reach, jumps that land where execution
+ * would go anyway and alu ops whose results are known, so removed words are also the cycles
+ * saved each time that code runs. Immediate jump targets are relocated afterwards; programs
+ * that jump through a register or exec a word from ram can land anywhere and are left alone.
+ */
+class Optimizer {
+    private:
+        std::vector<MicroOp> ops_;
+        std::vector<BasicBlock> blocks_;
+        bool relocatable_ = true;
+        OptimizerStats stats_;
+
+        void count(const std::string& name, uint32_t rewrites);
+
+        // first live op at or after index, ops_.size() when there is none
+        size_t next_live(size_t index) const;
+
+        // sets is_target_ on the first op and every op a live jump lands on
+        void mark_targets();
+
+        // rebuilds blocks_ from the live ops
+        void build_blocks();
+
+        struct HoistPlan;
+
+        // block holding a live op
+        size_t block_of(size_t op) const;
+
+        // picks a free register and the most used immediate of the loop, false when there is nothing to hoist
+        bool plan_hoist(const NaturalLoop& loop, const std::vector<uint16_t>& live_out, const std::vector<bool>& register_target, HoistPlan& plan) const;
+
+        // inserts the loads and rewrites the ops of every plan, owner is the plan whose loop holds each op
+        void apply_hoists(const std::vector<HoistPlan>& plans, const std::vector<int64_t>& owner);
+
+    public:
+        Optimizer() = default;
+
+        // register_jumps are jumps through a register whose target is known, as in OptimizerStats
+        void load(const std::vector<Word>& words, const LineMap& map, const std::vector<std::pair<uint32_t, uint32_t>>& register_jumps = {});
+
+        // loads words and builds their blocks without rewriting anything, for looking at the program as written
+        void analyze(const std::vector<Word>& words, const LineMap& map, const std::vector<std::pair<uint32_t, uint32_t>>& register_jumps = {});
+
+        const std::vector<MicroOp>& ops() const {
+            return ops_;
+        }
+
+        const std::vector<BasicBlock>& blocks() const {
+            return blocks_;
+        }
+
+        // runs every pass until none of them changes anything
+        void run();
+
+        // passes return true when they rewrote something
+        bool peephole();
+        bool track_values();
+        bool fold_constants();
+        bool remove_dead_loads();
+        bool thread_jumps();
+        bool remove_unreachable();
+
+        // runs last, the jumps it rewrites read their target from a register
+        bool hoist_invariants();
+
+        // writes the surviving ops back with jump targets relocated
+        void emit(std::vector<Word>& words, LineMap& map);
+
+        const OptimizerStats& stats() const {
+            return stats_;
+        }
+
+        static void report(const OptimizerStats& stats, std::ostream& out);
+
+        ~Optimizer() = default;
+};
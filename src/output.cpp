@@ -0,0 +1,325 @@
+#include "output.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <unistd.h>
+
+std::string FileSink::path(const std::string& name) const {
+    std::string file = name;
+
+    if (!base_.empty()) {
+        file = name.rfind("out.", 0) == 0 ? base_ + name.substr(3) : base_ + "." + name;
+    }
+
+    return directory_.empty() ? file : directory_ + "/" + file;
+}
+
+bool FileSink::write(const std::string& name, std::string_view contents) {
+    const std::string target = path(name);
+    const std::string file_name = atomic_ ? target + ".tmp." + std::to_string(getpid()) : target;
+
+    std::ofstream file { file_name };
+
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file.write(contents.data(), contents.size());
+    file.close();
+
+    if (!atomic_) {
+        return !file.fail();
+    }
+
+    if (file.fail() || std::rename(file_name.c_str(), target.c_str()) != 0) {
+        std::remove(file_name.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool StreamSink::write(const std::string& /* name */, std::string_view contents) {
+    out_.write(contents.data(), contents.size());
+    return !out_.fail();
+}
+
+bool MemorySink::write(const std::string& name, std::string_view contents) {
+    images_.emplace_back(name, std::string(contents));
+    return true;
+}
+
+const std::string* MemorySink::find(const std::string& name) const {
+    for (const auto& [image, contents] : images_) {
+        if (image == name) {
+            return &contents;
+        }
+    }
+
+    return nullptr;
+}
+
+bool parse_format(const std::string& name, OutputFormats& format) {
+    if (name == "raw") {
+        format = FORMAT_RAW;
+    } else if (name == "bin") {
+        format = FORMAT_BINARY;
+    } else if (name == "ihex") {
+        format = FORMAT_INTEL_HEX;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+// two upper case hex digits for every byte value
+struct HexTable {
+    char digits_[256][2];
+
+    constexpr HexTable() : digits_() {
+        constexpr char hex[] = "0123456789ABCDEF";
+
+        for (int i = 0; i < 256; ++i) {
+            digits_[i][0] = hex[i >> 4];
+            digits_[i][1] = hex[i & 0xF];
+        }
+    }
+};
+
+static constexpr HexTable hex_table;
+
+static char* put_hex(char* out, const uint8_t byte) {
+    memcpy(out, hex_table.digits_[byte], 2);
+    return out + 2;
+}
+
+static uint8_t from_hex(const char digit) {
+    return static_cast<uint8_t>(digit <= '9' ? digit - '0' : digit - 'A' + 10);
+}
+
+static constexpr std::string_view RAW_HEADER = "v2.0 raw\n";
+
+constexpr size_t IHEX_RECORD_BYTES = 16;
+
+// characters of a full data record, ":LLAAAATT" + 16 bytes + checksum + newline, and of an address record
+constexpr size_t IHEX_RECORD_SIZE = 9 + IHEX_RECORD_BYTES * 2 + 3;
+constexpr size_t IHEX_ADDRESS_SIZE = 9 + 2 * 2 + 3;
+constexpr size_t IHEX_END_SIZE = 9 + 3;
+
+// data records in each 64K bytes, an extended linear address record comes before each group but the first
+constexpr size_t IHEX_RECORDS_PER_SEGMENT = 0x10000 / IHEX_RECORD_BYTES;
+
+enum IntelHexRecords : uint8_t {
+    IHEX_DATA = 0x00,
+    IHEX_END = 0x01,
+    IHEX_EXTENDED_LINEAR = 0x04
+};
+
+// ":LLAAAATT" + data + checksum + newline
+static char* put_record(char* out, const IntelHexRecords kind, const uint16_t address, const uint8_t* data, const size_t size) {
+    uint8_t sum = static_cast<uint8_t>(size + (address >> 8) + address + kind);
+
+    *out++ = ':';
+    out = put_hex(out, static_cast<uint8_t>(size));
+    out = put_hex(out, static_cast<uint8_t>(address >> 8));
+    out = put_hex(out, static_cast<uint8_t>(address));
+    out = put_hex(out, kind);
+
+    for (size_t i = 0; i < size; ++i) {
+        sum += data[i];
+        out = put_hex(out, data[i]);
+    }
+
+    out = put_hex(out, static_cast<uint8_t>(-sum));
+    *out++ = '\n';
+
+    return out;
+}
+
+ImageEncoder::ImageEncoder(OutputTypes type, OutputFormats format, int shift) : type_(type), format_(format), shift_(shift) {
+    if (format_ == FORMAT_RAW) {
+        word_size_ = type_ == HALF_SINGLE_WORD ? 3 : (type_ == HALF_DUAL_WORD ? 6 : 5);
+    } else {
+        word_size_ = type_ == HALF_SINGLE_WORD ? 1 : 2;
+    }
+}
+
+void ImageEncoder::begin(std::string& out) {
+    if (format_ == FORMAT_RAW) {
+        out += RAW_HEADER;
+    }
+}
+
+size_t ImageEncoder::word_bytes(const Word word, uint8_t* bytes) const {
+    if (type_ == HALF_SINGLE_WORD) {
+        bytes[0] = static_cast<uint8_t>(word >> shift_);
+        return 1;
+    }
+
+    bytes[0] = static_cast<uint8_t>(word >> 8);
+    bytes[1] = static_cast<uint8_t>(word);
+
+    return 2;
+}
+
+void ImageEncoder::put_word(const Word word, char* out) const {
+    if (format_ == FORMAT_BINARY) {
+        word_bytes(word, reinterpret_cast<uint8_t*>(out));
+    } else if (type_ == HALF_SINGLE_WORD) {
+        put_hex(out, static_cast<uint8_t>(word >> shift_));
+    } else {
+        put_hex(out, static_cast<uint8_t>(word >> 8));
+        put_hex(out + word_size_ - 3, static_cast<uint8_t>(word));
+    }
+}
+
+void ImageEncoder::flush_record(std::string& out) {
+    const uint64_t address = (records_ * IHEX_RECORD_BYTES);
+
+    if (records_ != 0 && records_ % IHEX_RECORDS_PER_SEGMENT == 0) {
+        const uint8_t upper[2] = { static_cast<uint8_t>(address >> 24), static_cast<uint8_t>(address >> 16) };
+        char line[IHEX_ADDRESS_SIZE];
+        put_record(line, IHEX_EXTENDED_LINEAR, 0, upper, 2);
+        out.append(line, IHEX_ADDRESS_SIZE);
+    }
+
+    const size_t start = out.size();
+    out.resize(start + 9 + record_size_ * 2 + 3);
+    put_record(out.data() + start, IHEX_DATA, static_cast<uint16_t>(address), record_, record_size_);
+
+    record_size_ = 0;
+    ++records_;
+}
+
+void ImageEncoder::append(const Word* words, const size_t count, std::string& out) {
+    if (format_ == FORMAT_INTEL_HEX) {
+        out.reserve(out.size() + (count * word_size_ / IHEX_RECORD_BYTES + 1) * (IHEX_RECORD_SIZE + IHEX_ADDRESS_SIZE));
+
+        for (size_t i = 0; i < count; ++i) {
+            uint8_t bytes[2];
+            const size_t size = word_bytes(words[i], bytes);
+
+            // records hold an even number of bytes, so a word never spans two of them
+            memcpy(record_ + record_size_, bytes, size);
+            record_size_ += size;
+
+            if (record_size_ == IHEX_RECORD_BYTES) {
+                flush_record(out);
+            }
+        }
+
+        words_ += count;
+        return;
+    }
+
+    const size_t start = out.size();
+
+    // raw words are separated by spaces, the separators are already in place
+    out.resize(start + count * word_size_, ' ');
+
+    char* pos = out.data() + start;
+
+    for (size_t i = 0; i < count; ++i) {
+        put_word(words[i], pos);
+        pos += word_size_;
+    }
+
+    words_ += count;
+}
+
+void ImageEncoder::finish(std::string& out) {
+    if (format_ != FORMAT_INTEL_HEX) {
+        return;
+    }
+
+    if (record_size_ != 0) {
+        flush_record(out);
+    }
+
+    char line[IHEX_END_SIZE];
+    put_record(line, IHEX_END, 0, nullptr, 0);
+    out.append(line, IHEX_END_SIZE);
+}
+
+void ImageEncoder::locate(const uint64_t address, uint64_t& offset, size_t& size) const {
+    if (format_ != FORMAT_INTEL_HEX) {
+        const uint64_t header = format_ == FORMAT_RAW ? RAW_HEADER.size() : 0;
+
+        offset = header + address * word_size_;
+        size = format_ == FORMAT_RAW ? word_size_ - 1 : word_size_;
+        return;
+    }
+
+    const uint64_t record = address * word_size_ / IHEX_RECORD_BYTES;
+
+    offset = record * IHEX_RECORD_SIZE + (record / IHEX_RECORDS_PER_SEGMENT) * IHEX_ADDRESS_SIZE;
+    size = IHEX_RECORD_SIZE;
+}
+
+void ImageEncoder::patch(const uint64_t address, const Word word, std::string& unit) const {
+    if (format_ != FORMAT_INTEL_HEX) {
+        std::string text(word_size_, ' ');
+        put_word(word, text.data());
+        memcpy(unit.data(), text.data(), unit.size());
+        return;
+    }
+
+    uint8_t bytes[2];
+    const size_t size = word_bytes(word, bytes);
+    const size_t first = 9 + (address * word_size_ % IHEX_RECORD_BYTES) * 2;
+
+    for (size_t i = 0; i < size; ++i) {
+        put_hex(unit.data() + first + i * 2, bytes[i]);
+    }
+
+    // the checksum covers every byte from the length to the last data byte
+    uint8_t sum = 0;
+
+    for (size_t i = 1; i + 3 < unit.size(); i += 2) {
+        sum += static_cast<uint8_t>(from_hex(unit[i]) << 4 | from_hex(unit[i + 1]));
+    }
+
+    put_hex(unit.data() + unit.size() - 3, static_cast<uint8_t>(-sum));
+}
+
+bool ImageEncoder::patch_pending(const uint64_t address, const Word word) {
+    const uint64_t byte = address * word_size_;
+    const uint64_t written = records_ * IHEX_RECORD_BYTES;
+
+    if (format_ != FORMAT_INTEL_HEX || byte < written) {
+        return false;
+    }
+
+    word_bytes(word, record_ + (byte - written));
+    return true;
+}
+
+std::vector<ImageLayout> image_layouts(OutputTypes type, OutputFormats format) {
+    const std::string extension = format == FORMAT_RAW ? ".hex" : (format == FORMAT_BINARY ? ".bin" : ".ihex");
+
+    if (type == HALF_SINGLE_WORD) {
+        return { { "high" + extension, 8 }, { "low" + extension, 0 } };
+    }
+
+    return { { "out" + extension, 0 } };
+}
+
+bool write_images(const std::vector<Word>& words, OutputTypes type, OutputSink& sink, OutputFormats format) {
+    for (const ImageLayout& layout : image_layouts(type, format)) {
+        ImageEncoder encoder { type, format, layout.shift_ };
+        std::string image;
+
+        encoder.begin(image);
+        encoder.append(words.data(), words.size(), image);
+        encoder.finish(image);
+
+        if (!sink.write(layout.name_, image)) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "isa.hpp"
+
+// file format of the images, the layout of the words in them is set by OutputTypes
+enum OutputFormats {
+    FORMAT_RAW, // logisim v2.0 raw text: out.hex, or high.hex and low.hex
+    FORMAT_BINARY, // the bytes as they go into the eeprom: out.bin, or high.bin and low.bin
+    FORMAT_INTEL_HEX // intel hex records of the same bytes: out.ihex, or high.ihex and low.ihex
+};
+
+// receives finished images by name: "out.hex", or "high.hex" and "low.hex" for HALF_SINGLE_WORD
+class OutputSink {
+    public:
+        virtual bool write(const std::string& name, std::string_view contents) = 0;
+        virtual ~OutputSink() = default;
+};
+
+/*
+ * One file per image inside directory_ (the working directory when empty). Images keep their
+ * names unless base_ is set, then "out.hex" becomes base_.hex and "high.hex" base_.high.hex.
+ */
+class FileSink : public OutputSink {
+    private:
+        std::string directory_;
+        std::string base_;
+        bool atomic_ = false;
+
+    public:
+        explicit FileSink(const std::string& directory = "", const std::string& base = "") : directory_(directory), base_(base) {};
+
+        // file an image is written to
+        std::string path(const std::string& name) const;
+
+        // write each image to a temporary file and rename it over the old one, readers see either the old or the new image
+        void set_atomic(bool enabled) {
+            atomic_ = enabled;
+        }
+
+        bool write(const std::string& name, std::string_view contents) override;
+};
+
+// every image to the same stream, one after the other
+class StreamSink : public OutputSink {
+    private:
+        std::ostream& out_;
+
+    public:
+        explicit StreamSink(std::ostream& out) : out_(out) {};
+
+        bool write(const std::string& name, std::string_view contents) override;
+};
+
+// keeps the images in memory in the order they were written
+class MemorySink : public OutputSink {
+    public:
+        std::vector<std::pair<std::string, std::string>> images_;
+
+        bool write(const std::string& name, std::string_view contents) override;
+
+        // contents of the named image, nullptr when it was not written
+        const std::string* find(const std::string& name) const;
+};
+
+// "raw", "bin" or "ihex"
+bool parse_format(const std::string& name, OutputFormats& format);
+
+// file name and selected byte of one image
+struct ImageLayout {
+    std::string name_;
+    int shift_;
+};
+
+// high.<ext> and low.<ext> for HALF_SINGLE_WORD, out.<ext> otherwise
+std::vector<ImageLayout> image_layouts(OutputTypes type, OutputFormats format);
+
+/*
+ * Formats one image a piece at a time, so a program can be written while it is still being
+ * encoded. Every word takes the same number of characters (records for intel hex), which lets a
+ * word already written be found and patched in place.
+ */
+class ImageEncoder {
+    private:
+        OutputTypes type_;
+        OutputFormats format_;
+        int shift_;
+
+        // characters (bytes for binary and intel hex) each word takes
+        size_t word_size_;
+        uint64_t words_ = 0;
+
+        // intel hex data not yet written out as a record
+        uint8_t record_[16];
+        size_t record_size_ = 0;
+        uint64_t records_ = 0;
+
+        size_t word_bytes(Word word, uint8_t* bytes) const;
+        void put_word(Word word, char* out) const;
+        void flush_record(std::string& out);
+
+    public:
+        // shift picks the byte of a HALF_SINGLE_WORD image, 8 for high and 0 for low
+        ImageEncoder(OutputTypes type, OutputFormats format, int shift);
+
+        // each appends to out, call begin, then append as often as needed, then finish
+        void begin(std::string& out);
+        void append(const Word* words, size_t count, std::string& out);
+        void finish(std::string& out);
+
+        // position in the image of the unit holding the word at address: the word itself, or its intel hex record
+        void locate(uint64_t address, uint64_t& offset, size_t& size) const;
+
+        // rewrites the word at address inside unit, which was read from the position locate gave
+        void patch(uint64_t address, Word word, std::string& unit) const;
+
+        // rewrites a word still waiting for its intel hex record, false when it was already written out
+        bool patch_pending(uint64_t address, Word word);
+
+        uint64_t words() const {
+            return words_;
+        }
+};
+
+/*
+ * Formats words in the given layout and hands each image to sink in one write. Binary and intel
+ * hex hold bytes, so HALF_DUAL_WORD and FULL_SINGLE_WORD both give the high byte of each word
+ * followed by the low byte.
+ */
+bool write_images(const std::vector<Word>& words, OutputTypes type, OutputSink& sink, OutputFormats format = FORMAT_RAW);
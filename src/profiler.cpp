@@ -0,0 +1,181 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+Profiler::Profiler(const Profile& profile, const LineMap* map, const SourceFile* source) : profile_(profile), map_(map), source_(source) {
+    for (const ProfileCounter& counter : profile_.counters_) {
+        total_cycles_ += counter.cycles_;
+    }
+
+    // every back edge closes a loop running from its target to its source
+    for (const auto& [edge, count] : profile_.back_edges_) {
+        Loop loop { static_cast<uint32_t>(edge), static_cast<uint32_t>(edge >> 32), count, 0 };
+
+        for (uint32_t address = loop.head_; address <= loop.tail_; ++address) {
+            loop.cycles_ += profile_.counters_[address].cycles_;
+        }
+
+        loops_.push_back(loop);
+    }
+
+    std::sort(loops_.begin(), loops_.end(), [](const Loop& a, const Loop& b) {
+        return a.cycles_ != b.cycles_ ? a.cycles_ > b.cycles_ : a.head_ < b.head_;
+    });
+}
+
+uint32_t Profiler::key(uint32_t address) const {
+    if (map_ != nullptr) {
+        const LineMapEntry* entry = map_->find(address);
+
+        if (entry != nullptr) {
+            return entry->line_;
+        }
+    }
+
+    return address;
+}
+
+std::string Profiler::describe(uint32_t address) const {
+    std::stringstream text;
+
+    if (map_ != nullptr && map_->find(address) != nullptr) {
+        const uint32_t line = map_->find(address)->line_;
+        text << "line " << line;
+
+        if (source_ != nullptr) {
+            text << ": " << source_->line(line);
+        }
+    } else {
+        text << "0x" << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << address;
+    }
+
+    return text.str();
+}
+
+void Profiler::print(std::ostream& out, size_t top) const {
+    struct Hot {
+        uint32_t address_; // first address of the line
+        uint64_t hits_;
+        uint64_t cycles_;
+    };
+
+    std::map<uint32_t, Hot> grouped;
+
+    for (uint32_t address = 0; address < profile_.counters_.size(); ++address) {
+        const ProfileCounter& counter = profile_.counters_[address];
+
+        if (counter.cycles_ == 0) {
+            continue;
+        }
+
+        auto [it, inserted] = grouped.try_emplace(key(address), Hot { address, 0, 0 });
+        const LineMapEntry* entry = map_ != nullptr ? map_->find(address) : nullptr;
+
+        // hits of the first word of a line are the times the line ran, summed over every macro or .rep copy of it
+        if (entry != nullptr ? entry->address_ == address : inserted) {
+            it->second.hits_ += counter.hits_;
+        }
+
+        it->second.cycles_ += counter.cycles_;
+    }
+
+    std::vector<Hot> hot;
+
+    for (const auto& [_, entry] : grouped) {
+        hot.push_back(entry);
+    }
+
+    std::sort(hot.begin(), hot.end(), [](const Hot& a, const Hot& b) {
+        return a.cycles_ != b.cycles_ ? a.cycles_ > b.cycles_ : a.address_ < b.address_;
+    });
+
+    const double total = total_cycles_ > 0 ? static_cast<double>(total_cycles_) : 1.0;
+
+    out << std::dec << std::setfill(' ');
+    out << "profile: " << total_cycles_ << " cycles\n\n";
+    out << "hottest " << (map_ != nullptr ? "lines" : "addresses") << ":\n";
+    out << "  " << std::setw(14) << "cycles" << std::setw(8) << "%" << std::setw(14) << "runs" << "  source\n";
+
+    for (size_t i = 0; i < hot.size() && i < top; ++i) {
+        out << "  " << std::setw(14) << hot[i].cycles_
+            << std::setw(7) << std::fixed << std::setprecision(2) << hot[i].cycles_ * 100.0 / total << '%'
+            << std::setw(14) << hot[i].hits_ << "  " << describe(hot[i].address_) << '\n';
+    }
+
+    out << "\nhottest loops:\n";
+
+    if (loops_.empty()) {
+        out << "  none\n";
+    }
+
+    for (size_t i = 0; i < loops_.size() && i < top; ++i) {
+        const Loop& loop = loops_[i];
+
+        out << "  0x" << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << loop.head_
+            << "-0x" << std::setw(4) << loop.tail_ << std::dec << std::setfill(' ');
+
+        if (map_ != nullptr) {
+            out << " (lines " << key(loop.head_) << "-" << key(loop.tail_) << ")";
+        }
+
+        out << ": " << loop.cycles_ << " cycles (" << std::fixed << std::setprecision(2) << loop.cycles_ * 100.0 / total << "%), "
+            << loop.iterations_ << " iterations, " << std::setprecision(1) << static_cast<double>(loop.cycles_) / loop.iterations_
+            << " cycles/iteration\n";
+    }
+}
+
+bool Profiler::write_collapsed(const std::string& file_name) const {
+    std::ofstream file { file_name };
+
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // outermost loop first so nested loops stack inside it
+    std::vector<Loop> by_size = loops_;
+
+    std::sort(by_size.begin(), by_size.end(), [](const Loop& a, const Loop& b) {
+        const uint32_t a_size = a.tail_ - a.head_;
+        const uint32_t b_size = b.tail_ - b.head_;
+
+        return a_size != b_size ? a_size > b_size : a.head_ < b.head_;
+    });
+
+    std::map<std::string, uint64_t> stacks;
+
+    for (uint32_t address = 0; address < profile_.counters_.size(); ++address) {
+        const uint64_t cycles = profile_.counters_[address].cycles_;
+
+        if (cycles == 0) {
+            continue;
+        }
+
+        // ; separates frames so it can not appear inside one
+        auto frame = [](std::string text) {
+            std::replace(text.begin(), text.end(), ';', ',');
+            return text;
+        };
+
+        std::string stack = "program";
+
+        for (const Loop& loop : by_size) {
+            if (address >= loop.head_ && address <= loop.tail_) {
+                stack += ";" + frame("loop " + describe(loop.head_) + " .. " + describe(loop.tail_));
+            }
+        }
+
+        stack += ";" + frame(describe(address));
+
+        stacks[stack] += cycles;
+    }
+
+    for (const auto& [stack, cycles] : stacks) {
+        file << stack << ' ' << cycles << '\n';
+    }
+
+    return file.good();
+}
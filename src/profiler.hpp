@@ -0,0 +1,45 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+#include "emulator.hpp"
+#include "linemap.hpp"
+#include "source.hpp"
+
+/*
+ * Turns the per address counters of a profiled run into reports. With a line map (splc -g)
+ * addresses are grouped by source line, otherwise every address is reported on its own.
+ */
+class Profiler {
+    private:
+        struct Loop {
+            uint32_t head_;
+            uint32_t tail_;
+            uint64_t iterations_;
+            uint64_t cycles_;
+        };
+
+        const Profile& profile_;
+        const LineMap* map_;
+        const SourceFile* source_;
+
+        std::vector<Loop> loops_;
+        uint64_t total_cycles_ = 0;
+
+        // source line (or address when there is no map) an address is reported under
+        uint32_t key(uint32_t address) const;
+        std::string describe(uint32_t address) const;
+
+    public:
+        Profiler() = delete;
+
+        Profiler(const Profile& profile, const LineMap* map, const SourceFile* source);
+
+        void print(std::ostream& out, size_t top) const;
+
+        // one "frame;frame;... cycles" line per source line, frames are the loops it sits in
+        bool write_collapsed(const std::string& file_name) const;
+
+        ~Profiler() = default;
+};
@@ -0,0 +1,142 @@
+#include "source.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void SourceFile::release() {
+    if (mapping_ != nullptr) {
+        munmap(mapping_, size_);
+        mapping_ = nullptr;
+    }
+
+    buffer_.clear();
+    line_starts_.clear();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+bool SourceFile::map_file(int fd, size_t size) {
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    mapping_ = mapping;
+    data_ = static_cast<const char*>(mapping);
+    size_ = size;
+
+    return true;
+}
+
+bool SourceFile::read_fd(int fd) {
+    char chunk[64 * 1024];
+    ssize_t count;
+
+    while ((count = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        buffer_.append(chunk, count);
+    }
+
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+
+    return true;
+}
+
+void SourceFile::index_lines() {
+    line_starts_.reserve(size_ / 16 + 1);
+    line_starts_.push_back(0);
+
+    const char* pos = data_;
+    const char* end = data_ + size_;
+
+    while ((pos = static_cast<const char*>(memchr(pos, '\n', end - pos))) != nullptr) {
+        ++pos;
+
+        if (pos == end) {
+            break;
+        }
+
+        line_starts_.push_back(static_cast<uint32_t>(pos - data_));
+    }
+}
+
+bool SourceFile::open(const std::string& file_name) {
+    release();
+
+    if (file_name == "-") {
+        if (!read_fd(STDIN_FILENO)) {
+            return false;
+        }
+
+        index_lines();
+        return true;
+    }
+
+    int fd = ::open(file_name.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    bool ok;
+
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && static_cast<size_t>(info.st_size) >= MMAP_THRESHOLD) {
+        // pipes, devices and mmap failures fall back to a buffered read
+        ok = map_file(fd, info.st_size) || read_fd(fd);
+    } else {
+        ok = read_fd(fd);
+    }
+
+    close(fd);
+
+    if (ok) {
+        index_lines();
+    }
+
+    return ok;
+}
+
+void SourceFile::view(std::string_view text) {
+    release();
+
+    data_ = text.data();
+    size_ = text.size();
+
+    index_lines();
+}
+
+std::string_view SourceFile::line(size_t number) const {
+    if (number == 0 || number > line_starts_.size()) {
+        return std::string_view();
+    }
+
+    const size_t start = line_starts_[number - 1];
+    size_t end = number < line_starts_.size() ? line_starts_[number] - 1 : size_;
+
+    if (end > start && data_[end - 1] == '\n') {
+        --end;
+    }
+
+    if (end > start && data_[end - 1] == '\r') {
+        --end;
+    }
+
+    return std::string_view(data_ + start, end - start);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// files smaller than this are read into memory instead of being mapped
+constexpr size_t MMAP_THRESHOLD = 16 * 1024;
+
+// read only view of a whole source file with an index of where each line starts
+class SourceFile {
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+
+        void* mapping_ = nullptr;
+        std::string buffer_;
+
+        std::vector<uint32_t> line_starts_;
+
+        bool map_file(int fd, size_t size);
+        bool read_fd(int fd);
+        void index_lines();
+        void release();
+
+    public:
+        SourceFile() = default;
+
+        SourceFile(const SourceFile&) = delete;
+        SourceFile& operator=(const SourceFile&) = delete;
+
+        // loads file_name, "-" reads standard input
+        bool open(const std::string& file_name);
+
+        // uses text in place without copying it, text has to outlive the SourceFile
+        void view(std::string_view text);
+
+        std::string_view text() const {
+            return std::string_view(data_, size_);
+        }
+
+        size_t line_count() const {
+            return line_starts_.size();
+        }
+
+        // 1 based line number, without the line ending
+        std::string_view line(size_t number) const;
+
+        bool is_mapped() const {
+            return mapping_ != nullptr;
+        }
+
+        ~SourceFile() {
+            release();
+        }
+};
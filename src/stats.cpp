@@ -0,0 +1,138 @@
+#include "stats.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+#include <sys/resource.h>
+
+#include "cache.hpp"
+
+void CompileStats::add_pass(const std::string& name, const double seconds) {
+    for (PassTime& pass : passes_) {
+        if (pass.name_ == name) {
+            pass.seconds_ += seconds;
+            return;
+        }
+    }
+
+    passes_.push_back({ name, seconds });
+}
+
+void CompileStats::add(const CompileStats& other) {
+    for (const PassTime& pass : other.passes_) {
+        add_pass(pass.name_, pass.seconds_);
+    }
+
+    files_ += other.files_;
+    cached_ += other.cached_;
+    source_bytes_ += other.source_bytes_;
+    lines_ += other.lines_;
+    instructions_ += other.instructions_;
+    labels_ += other.labels_;
+    words_ += other.words_;
+    bytes_written_ += other.bytes_written_;
+
+    for (int i = 0; i <= HLT; ++i) {
+        instruction_words_[i] += other.instruction_words_[i];
+    }
+
+    arena_bytes_ = std::max(arena_bytes_, other.arena_bytes_);
+    peak_memory_ = std::max(peak_memory_, other.peak_memory_);
+}
+
+void CompileStats::sample_memory() {
+    rusage usage {};
+
+    // ru_maxrss is in kilobytes on linux
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        peak_memory_ = std::max(peak_memory_, static_cast<uint64_t>(usage.ru_maxrss) * 1024);
+    }
+}
+
+void CompileStats::print_table(std::ostream& out, const bool counts) const {
+    double total = 0;
+
+    for (const PassTime& pass : passes_) {
+        total += pass.seconds_;
+    }
+
+    const std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+
+    out << std::left << std::setw(14) << "pass" << std::right << std::setw(12) << "time (ms)" << std::setw(9) << "share" << '\n';
+
+    for (const PassTime& pass : passes_) {
+        out << std::left << std::setw(14) << pass.name_ << std::right << std::setw(12) << pass.seconds_ * 1000
+            << std::setw(8) << std::setprecision(1) << (total > 0 ? pass.seconds_ * 100 / total : 0) << '%' << std::setprecision(3) << '\n';
+    }
+
+    out << std::left << std::setw(14) << "total" << std::right << std::setw(12) << total * 1000 << '\n';
+
+    if (counts) {
+        auto row = [&](const char* name, const uint64_t value) {
+            out << std::left << std::setw(14) << name << std::right << std::setw(12) << value << '\n';
+        };
+
+        out << '\n';
+        row("files", files_);
+        row("cached", cached_);
+        row("source bytes", source_bytes_);
+        row("lines", lines_);
+        row("instructions", instructions_);
+        row("labels", labels_);
+        row("words", words_);
+        row("bytes written", bytes_written_);
+        row("arena bytes", arena_bytes_);
+        row("peak memory", peak_memory_);
+
+        uint64_t encoded = 0;
+
+        for (const uint64_t words : instruction_words_) {
+            encoded += words;
+        }
+
+        out << '\n' << std::left << std::setw(14) << "instruction" << std::right << std::setw(12) << "words" << std::setw(9) << "share" << '\n';
+
+        for (int i = 0; i <= HLT; ++i) {
+            out << std::left << std::setw(14) << instruction_table[i].name_ << std::right << std::setw(12) << instruction_words_[i]
+                << std::setw(8) << std::setprecision(1) << (encoded > 0 ? instruction_words_[i] * 100.0 / encoded : 0) << '%' << std::setprecision(3) << '\n';
+        }
+    }
+
+    out.flags(flags);
+}
+
+void CompileStats::print_json(std::ostream& out) const {
+    const std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(6);
+
+    out << "{\n";
+    out << "  \"version\": \"" << SPLC_VERSION << "\",\n";
+    out << "  \"passes\": [";
+
+    for (size_t i = 0; i < passes_.size(); ++i) {
+        out << (i == 0 ? "" : ", ") << "{\"name\": \"" << passes_[i].name_ << "\", \"ms\": " << passes_[i].seconds_ * 1000 << "}";
+    }
+
+    out << "],\n";
+    out << "  \"files\": " << files_ << ",\n";
+    out << "  \"cached\": " << cached_ << ",\n";
+    out << "  \"source_bytes\": " << source_bytes_ << ",\n";
+    out << "  \"lines\": " << lines_ << ",\n";
+    out << "  \"instructions\": " << instructions_ << ",\n";
+    out << "  \"labels\": " << labels_ << ",\n";
+    out << "  \"words\": " << words_ << ",\n";
+    out << "  \"instruction_words\": {";
+
+    for (int i = 0; i <= HLT; ++i) {
+        out << (i == 0 ? "" : ", ") << "\"" << instruction_table[i].name_ << "\": " << instruction_words_[i];
+    }
+
+    out << "},\n";
+    out << "  \"bytes_written\": " << bytes_written_ << ",\n";
+    out << "  \"arena_bytes\": " << arena_bytes_ << ",\n";
+    out << "  \"peak_memory_bytes\": " << peak_memory_ << "\n";
+    out << "}\n";
+
+    out.flags(flags);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "encoder.hpp"
+
+struct PassTime {
+    std::string name_;
+    double seconds_ = 0;
+};
+
+/*
+ * What a compile spent its time and memory on. Passes are kept in the order they first ran and
+ * add up when a pass runs more than once, so one CompileStats can cover a whole batch.
+ */
+struct CompileStats {
+    std::vector<PassTime> passes_;
+
+    uint64_t files_ = 0;
+    uint64_t cached_ = 0;
+    uint64_t source_bytes_ = 0;
+    uint64_t lines_ = 0;
+    uint64_t instructions_ = 0;
+    uint64_t labels_ = 0;
+
+    // words written, after the optimizer when it ran
+    uint64_t words_ = 0;
+
+    // words each instruction encoded to, indexed by Instructions, before the optimizer
+    uint64_t instruction_words_[HLT + 1] = {};
+
+    uint64_t bytes_written_ = 0;
+
+    // largest arena of a single compile and the peak resident size of the whole process
+    uint64_t arena_bytes_ = 0;
+    uint64_t peak_memory_ = 0;
+
+    void add_pass(const std::string& name, double seconds);
+    void add(const CompileStats& other);
+
+    // reads the peak resident size of the process
+    void sample_memory();
+
+    // timing only, or timing and every count
+    void print_table(std::ostream& out, bool counts) const;
+    void print_json(std::ostream& out) const;
+};
+
+// adds the time from construction to destruction to a pass, does nothing without stats
+class PassTimer {
+    private:
+        CompileStats* stats_;
+        const char* name_;
+        std::chrono::steady_clock::time_point start_;
+
+    public:
+        PassTimer(CompileStats* stats, const char* name) : stats_(stats), name_(name) {
+            if (stats_ != nullptr) {
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+
+        PassTimer(const PassTimer&) = delete;
+        PassTimer& operator=(const PassTimer&) = delete;
+
+        ~PassTimer() {
+            if (stats_ != nullptr) {
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+                stats_->add_pass(name_, elapsed.count());
+            }
+        }
+};
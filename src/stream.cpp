@@ -0,0 +1,427 @@
+#include "compiler.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// bytes of source read at a time, a line longer than this grows the buffer
+constexpr size_t STREAM_CHUNK_SIZE = 1 << 20;
+
+// an image written to a temporary file as it is encoded, renamed over path_ once it is complete
+struct StreamImage {
+    ImageEncoder encoder_;
+    std::string path_;
+    std::string temp_;
+    int fd_ = -1;
+
+    // formatted words of the current chunk
+    std::string buffer_;
+};
+
+// a label operand written before its label was seen, the word at address_ gets the label address
+struct PatchRecord {
+    uint64_t address_;
+    uint32_t line_;
+};
+
+struct StreamState {
+    std::vector<StreamImage> images_;
+
+    std::ofstream map_;
+    std::string map_path_;
+    std::string map_temp_;
+
+    // every label seen so far and its address, the only thing kept for the whole program
+    std::unordered_map<std::string, uint64_t> labels_;
+    std::unordered_map<std::string, std::vector<PatchRecord>> pending_;
+
+    // patches whose label turned up in the current chunk, and the value they get
+    std::vector<std::pair<uint64_t, Word>> ready_;
+
+    // labels of the current chunk and the address of each of its instructions
+    std::vector<std::pair<std::string_view, uint64_t>> defined_;
+    std::vector<uint64_t> addresses_;
+
+    uint64_t address_ = 0;
+    uint32_t line_ = 1;
+};
+
+static bool write_all(const int fd, const std::string& data) {
+    size_t written = 0;
+
+    while (written < data.size()) {
+        const ssize_t count = ::write(fd, data.data() + written, data.size() - written);
+
+        if (count <= 0) {
+            return false;
+        }
+
+        written += count;
+    }
+
+    return true;
+}
+
+// rewrites one word of an image, in the file or in the record still being filled
+static bool patch_image(StreamImage& image, const uint64_t address, const Word word) {
+    if (image.encoder_.patch_pending(address, word)) {
+        return true;
+    }
+
+    uint64_t offset;
+    size_t size;
+    image.encoder_.locate(address, offset, size);
+
+    std::string unit(size, '\0');
+
+    if (pread(image.fd_, unit.data(), size, offset) != static_cast<ssize_t>(size)) {
+        return false;
+    }
+
+    image.encoder_.patch(address, word, unit);
+
+    return pwrite(image.fd_, unit.data(), size, offset) == static_cast<ssize_t>(size);
+}
+
+// closes the temporary files and moves them over the outputs, or removes them when keep is false
+static bool close_outputs(StreamState& state, const bool keep) {
+    bool ok = true;
+
+    for (StreamImage& image : state.images_) {
+        if (image.fd_ < 0) {
+            continue;
+        }
+
+        ok = ::close(image.fd_) == 0 && ok;
+        image.fd_ = -1;
+
+        if (!keep || !ok || std::rename(image.temp_.c_str(), image.path_.c_str()) != 0) {
+            std::remove(image.temp_.c_str());
+            ok = false;
+        }
+    }
+
+    if (state.map_.is_open()) {
+        state.map_.close();
+
+        if (!keep || !ok || state.map_.fail() || std::rename(state.map_temp_.c_str(), state.map_path_.c_str()) != 0) {
+            std::remove(state.map_temp_.c_str());
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+Errors SCompiler::stream_chunk(const std::string_view chunk, StreamState& state) {
+    {
+        PassTimer timer { stats_, "parse" };
+
+        tokens_ = TokenList();
+        arena_.reset();
+        label_uses_.clear();
+        state.defined_.clear();
+        state.addresses_.clear();
+
+        const uint32_t newlines = static_cast<uint32_t>(std::count(chunk.begin(), chunk.end(), '\n'));
+
+        tokens_.reserve(arena_, newlines + 1);
+
+        Lexer lexer { chunk, state.line_ };
+        LexToken line;
+
+        while (lexer.next(line)) {
+            if (!line.label_.empty()) {
+                if (!check_label(line)) {
+                    return invalid_label;
+                }
+
+                if (!state.labels_.emplace(line.label_, state.address_).second) {
+                    error(line.line_, "Duplicate label: " + std::string(line.label_) + " on line " + std::to_string(line.line_));
+                    return invalid_label;
+                }
+
+                state.defined_.push_back({ line.label_, state.address_ });
+
+                if (line.mnemonic_.empty()) {
+                    continue;
+                }
+            }
+
+            // a .rep or macro body can be split across chunks and its copies need the whole program
+            if (!line.mnemonic_.empty() && line.mnemonic_[0] == '.') {
+                error(line.line_, "Directives can not be streamed: " + std::string(line.mnemonic_) + " on line " + std::to_string(line.line_));
+                return invalid_instruction;
+            }
+
+            const Errors result = parse_instruction(line);
+
+            if (result != OK) {
+                return result;
+            }
+
+            const size_t token = tokens_.size() - 1;
+
+            state.addresses_.push_back(state.address_);
+            state.address_ += instruction_size(tokens_.opcode(token), tokens_.kind(token, 0), tokens_.kind(token, 1));
+        }
+
+        state.line_ += newlines;
+    }
+
+    {
+        PassTimer timer { stats_, "resolve" };
+
+        // uses in earlier chunks of the labels this one defines
+        for (const auto& [name, target] : state.defined_) {
+            if (state.pending_.empty()) {
+                break;
+            }
+
+            const auto waiting = state.pending_.find(std::string(name));
+
+            if (waiting == state.pending_.end()) {
+                continue;
+            }
+
+            for (const PatchRecord& patch : waiting->second) {
+                if (target > 0xFFFF) {
+                    error(patch.line_, "Label out of range: " + std::string(name) + " on line " + std::to_string(patch.line_));
+                    return invalid_label;
+                }
+
+                state.ready_.push_back({ patch.address_, static_cast<Word>(target) });
+            }
+
+            state.pending_.erase(waiting);
+        }
+
+        for (const LabelUse& use : label_uses_) {
+            const uint32_t line = tokens_.lines_[use.token_];
+            const auto label = state.labels_.find(std::string(use.name_));
+
+            if (label == state.labels_.end()) {
+                const int offset = immediate_offset(tokens_.opcode(use.token_), tokens_.kind(use.token_, 0), tokens_.kind(use.token_, 1), use.operand_);
+                state.pending_[std::string(use.name_)].push_back({ state.addresses_[use.token_] + offset, line });
+                continue;
+            }
+
+            if (label->second > 0xFFFF) {
+                error(line, "Label out of range: " + std::string(use.name_) + " on line " + std::to_string(line));
+                return invalid_label;
+            }
+
+            tokens_.values_[use.operand_][use.token_] = static_cast<uint16_t>(label->second);
+        }
+    }
+
+    {
+        PassTimer timer { stats_, "encode" };
+
+        output_.clear();
+        output_.reserve(tokens_.size() * 2);
+
+        const uint64_t first = state.addresses_.empty() ? 0 : state.addresses_.front();
+
+        for (size_t token = 0; token < tokens_.size(); ++token) {
+            const Operand operands[MAX_OPERANDS] = { tokens_.operand(token, 0), tokens_.operand(token, 1) };
+            const uint32_t address = static_cast<uint32_t>(output_.size());
+
+            encode(tokens_.opcode(token), operands, output_);
+
+            if (state.map_.is_open()) {
+                LineMap::write_entry(state.map_, { static_cast<uint32_t>(first + address), static_cast<uint32_t>(output_.size()) - address, tokens_.lines_[token] });
+            }
+        }
+    }
+
+    if (stats_ != nullptr) {
+        count_stats();
+        stats_->labels_ += state.defined_.size();
+        stats_->words_ += output_.size();
+    }
+
+    PassTimer timer { stats_, "write" };
+
+    for (StreamImage& image : state.images_) {
+        image.buffer_.clear();
+        image.encoder_.append(output_.data(), output_.size(), image.buffer_);
+
+        if (!write_all(image.fd_, image.buffer_)) {
+            return file_write_error;
+        }
+
+        if (stats_ != nullptr) {
+            stats_->bytes_written_ += image.buffer_.size();
+        }
+
+        for (const auto& [address, word] : state.ready_) {
+            if (!patch_image(image, address, word)) {
+                return file_write_error;
+            }
+        }
+    }
+
+    state.ready_.clear();
+
+    return OK;
+}
+
+int SCompiler::compile_stream(const std::string& file_name) {
+    reset();
+
+    StreamState state;
+    Errors status = OK;
+
+    const int fd = file_name == "-" ? STDIN_FILENO : ::open(file_name.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        std::cout << "File not found: " << file_name << '\n';
+        return 1;
+    }
+
+    FileSink sink;
+
+    for (const ImageLayout& layout : image_layouts(output_type_, format_)) {
+        const std::string path = sink.path(layout.name_);
+        StreamImage image { ImageEncoder(output_type_, format_, layout.shift_), path, path + ".tmp." + std::to_string(getpid()), -1, {} };
+        image.fd_ = ::open(image.temp_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+        if (image.fd_ < 0) {
+            status = file_write_error;
+            break;
+        }
+
+        image.encoder_.begin(image.buffer_);
+        state.images_.push_back(std::move(image));
+
+        if (!write_all(state.images_.back().fd_, state.images_.back().buffer_)) {
+            status = file_write_error;
+            break;
+        }
+    }
+
+    if (status == OK && write_map_) {
+        state.map_path_ = sink.path("out.map");
+        state.map_temp_ = state.map_path_ + ".tmp." + std::to_string(getpid());
+        state.map_.open(state.map_temp_);
+
+        if (!state.map_.is_open()) {
+            status = file_write_error;
+        } else {
+            LineMap::write_header(state.map_, file_name);
+        }
+    }
+
+    std::string buffer(STREAM_CHUNK_SIZE, '\0');
+    size_t filled = 0;
+    uint64_t source_bytes = 0;
+    char last_byte = '\n';
+    bool at_end = false;
+
+    while (status == OK && !at_end) {
+        if (filled == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+
+        ssize_t count;
+
+        {
+            PassTimer timer { stats_, "load" };
+            count = ::read(fd, buffer.data() + filled, buffer.size() - filled);
+        }
+
+        if (count < 0) {
+            status = file_not_found;
+            break;
+        }
+
+        at_end = count == 0;
+        filled += count;
+        source_bytes += count;
+
+        if (count > 0) {
+            last_byte = buffer[filled - 1];
+        }
+
+        // only whole lines are compiled, the rest waits for the next read
+        const char* last = static_cast<const char*>(memrchr(buffer.data(), '\n', filled));
+        const size_t size = at_end ? filled : (last == nullptr ? 0 : last - buffer.data() + 1);
+
+        if (size == 0) {
+            continue;
+        }
+
+        status = stream_chunk(std::string_view(buffer.data(), size), state);
+
+        memmove(buffer.data(), buffer.data() + size, filled - size);
+        filled -= size;
+    }
+
+    if (fd != STDIN_FILENO) {
+        ::close(fd);
+    }
+
+    if (status == OK && !state.pending_.empty()) {
+        // report the first use of a label that never turned up, as compile does
+        const std::string* name = nullptr;
+        uint32_t line = 0;
+
+        for (const auto& [label, patches] : state.pending_) {
+            if (name == nullptr || patches.front().line_ < line) {
+                name = &label;
+                line = patches.front().line_;
+            }
+        }
+
+        error(line, "Undefined label: " + *name + " on line " + std::to_string(line));
+        status = invalid_label;
+    }
+
+    if (status == OK) {
+        PassTimer timer { stats_, "write" };
+
+        for (StreamImage& image : state.images_) {
+            image.buffer_.clear();
+            image.encoder_.finish(image.buffer_);
+
+            if (!write_all(image.fd_, image.buffer_)) {
+                status = file_write_error;
+            }
+
+            if (stats_ != nullptr) {
+                stats_->bytes_written_ += image.buffer_.size();
+            }
+        }
+    }
+
+    if (stats_ != nullptr) {
+        ++stats_->files_;
+        stats_->source_bytes_ += source_bytes;
+
+        // counted the way SourceFile does, an unterminated last line counts and an empty file has one line
+        stats_->lines_ += std::max<uint64_t>(1, state.line_ - 1 + (last_byte != '\n'));
+    }
+
+    const bool written = close_outputs(state, status == OK);
+
+    for (const Diagnostic& diagnostic : diagnostics_) {
+        std::cout << diagnostic.message_ << '\n';
+    }
+
+    reset();
+
+    if (status == file_write_error || (status == OK && !written)) {
+        std::cout << (output_type_ == HALF_SINGLE_WORD ? "Failed to open output files" : "Failed to open output file") << '\n';
+        return 1;
+    }
+
+    if (status == file_not_found) {
+        std::cout << "Failed to read: " << file_name << '\n';
+    }
+
+    return status == OK ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        queues_.push_back(std::make_unique<WorkQueue>());
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this, i] { work(i); });
+    }
+}
+
+bool ThreadPool::take(const size_t worker, Task& task) {
+    {
+        WorkQueue& own = *queues_[worker];
+        std::lock_guard<std::mutex> lock { own.mutex_ };
+
+        if (!own.tasks_.empty()) {
+            task = std::move(own.tasks_.back());
+            own.tasks_.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < queues_.size(); ++offset) {
+        WorkQueue& victim = *queues_[(worker + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock { victim.mutex_ };
+
+        if (!victim.tasks_.empty()) {
+            task = std::move(victim.tasks_.front());
+            victim.tasks_.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::work(const size_t worker) {
+    while (true) {
+        Task task;
+
+        if (take(worker, task)) {
+            {
+                std::lock_guard<std::mutex> lock { mutex_ };
+                --queued_;
+            }
+
+            task();
+
+            std::lock_guard<std::mutex> lock { mutex_ };
+
+            if (--pending_ == 0) {
+                idle_.notify_all();
+            }
+
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock { mutex_ };
+        wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+
+        if (stop_ && queued_ == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    size_t queue;
+
+    // counted before it is queued, so a worker can never finish it before it is counted
+    {
+        std::lock_guard<std::mutex> lock { mutex_ };
+        queue = next_queue_++ % queues_.size();
+        ++queued_;
+        ++pending_;
+    }
+
+    {
+        WorkQueue& target = *queues_[queue];
+        std::lock_guard<std::mutex> lock { target.mutex_ };
+        target.tasks_.push_back(std::move(task));
+    }
+
+    wake_.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock { mutex_ };
+    idle_.wait(lock, [this] { return pending_ == 0; });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock { mutex_ };
+        stop_ = true;
+    }
+
+    wake_.notify_all();
+
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads with a task queue each. Submitted tasks are dealt round robin,
+ * a worker runs its own queue newest first and, once that is empty, steals the oldest task from
+ * another worker, so uneven tasks (one huge file among small ones) still keep every core busy.
+ */
+class ThreadPool {
+    private:
+        using Task = std::function<void()>;
+
+        struct WorkQueue {
+            std::mutex mutex_;
+            std::deque<Task> tasks_;
+        };
+
+        std::vector<std::unique_ptr<WorkQueue>> queues_;
+        std::vector<std::thread> workers_;
+
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable idle_;
+
+        // guarded by mutex_, queued_ counts tasks not yet taken and pending_ tasks not yet finished
+        size_t queued_ = 0;
+        size_t pending_ = 0;
+        size_t next_queue_ = 0;
+        bool stop_ = false;
+
+        bool take(size_t worker, Task& task);
+        void work(size_t worker);
+
+    public:
+        // 0 threads uses one per core
+        explicit ThreadPool(size_t threads = 0);
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void submit(Task task);
+
+        // blocks until every submitted task has finished
+        void wait();
+
+        size_t size() const {
+            return workers_.size();
+        }
+
+        ~ThreadPool();
+};
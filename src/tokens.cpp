@@ -0,0 +1,46 @@
+#include "tokens.hpp"
+
+#include <algorithm>
+
+template <typename T>
+static void grow(Arena& arena, T*& array, const size_t size, const size_t capacity) {
+    T* grown = arena.allocate<T>(capacity);
+
+    if (size > 0) {
+        std::copy(array, array + size, grown);
+    }
+
+    array = grown;
+}
+
+void TokenList::reserve(Arena& arena, const size_t capacity) {
+    if (capacity <= capacity_) {
+        return;
+    }
+
+    grow(arena, opcodes_, size_, capacity);
+    grow(arena, lines_, size_, capacity);
+
+    for (size_t operand = 0; operand < MAX_OPERANDS; ++operand) {
+        grow(arena, kinds_[operand], size_, capacity);
+        grow(arena, values_[operand], size_, capacity);
+    }
+
+    capacity_ = capacity;
+}
+
+size_t TokenList::push(Arena& arena, const Instructions inst, const uint32_t line) {
+    if (size_ == capacity_) {
+        reserve(arena, capacity_ == 0 ? 64 : capacity_ * 2);
+    }
+
+    opcodes_[size_] = static_cast<uint8_t>(inst);
+    lines_[size_] = line;
+
+    for (size_t operand = 0; operand < MAX_OPERANDS; ++operand) {
+        kinds_[operand][size_] = NONE;
+        values_[operand][size_] = 0;
+    }
+
+    return size_++;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "arena.hpp"
+#include "encoder.hpp"
+
+/*
+ * Parsed instructions as parallel arrays, one entry per instruction. Operands are already
+ * resolved to register indices and 16 bit immediates (label operands get theirs in
+ * resolve_labels), so encoding never looks at the source text again. The arrays come from an
+ * arena and are sized up front from the number of source lines.
+ */
+struct TokenList {
+    uint8_t* opcodes_ = nullptr; // Instructions
+    uint8_t* kinds_[MAX_OPERANDS] {}; // Types, NONE for missing operands
+    uint16_t* values_[MAX_OPERANDS] {};
+    uint32_t* lines_ = nullptr;
+
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+
+    // makes room for capacity tokens, anything already pushed is copied over
+    void reserve(Arena& arena, size_t capacity);
+
+    // appends an instruction without operands and returns its index
+    size_t push(Arena& arena, Instructions inst, uint32_t line);
+
+    Instructions opcode(const size_t index) const {
+        return static_cast<Instructions>(opcodes_[index]);
+    }
+
+    Types kind(const size_t index, const size_t operand) const {
+        return static_cast<Types>(kinds_[operand][index]);
+    }
+
+    Operand operand(const size_t index, const size_t operand) const {
+        return { kind(index, operand), values_[operand][index] };
+    }
+
+    size_t size() const {
+        return size_;
+    }
+};
+
+// operand naming a label, patched with the label address once every address is known
+struct LabelUse {
+    std::string_view name_;
+    uint32_t token_;
+    uint8_t operand_;
+};
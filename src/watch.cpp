@@ -0,0 +1,166 @@
+#include "watch.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "compiler.hpp"
+
+// inotify events that mean a file has new contents: written and closed, or renamed into place
+constexpr uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+struct WatchedFile {
+    const BatchJob* job_;
+    std::string name_; // file name inside the watched directory
+
+    // resident between rebuilds
+    std::unique_ptr<SCompiler> compiler_;
+};
+
+static void rebuild(WatchedFile& file, std::ostream& log) {
+    const auto start = std::chrono::steady_clock::now();
+    const BatchJob& job = *file.job_;
+
+    CacheEntry output;
+    const CompileResult result = file.compiler_->compile_output(job.input_, output);
+
+    for (const Diagnostic& diagnostic : result.diagnostics_) {
+        log << job.input_ << ": " << diagnostic.message_ << '\n';
+    }
+
+    if (!result.ok_) {
+        log << job.input_ << ": failed, keeping the previous output" << std::endl;
+        return;
+    }
+
+    FileSink sink { "", job.output_ };
+    sink.set_atomic(true);
+
+    std::string failed;
+
+    if (!file.compiler_->write_output(output, sink, failed)) {
+        log << job.input_ << ": Failed to open output file: " << sink.path(failed) << std::endl;
+        return;
+    }
+
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    log << job.input_ << ": " << result.words_.size() << " words" << (result.cached_ ? " (cached)" : "")
+        << " in " << elapsed.count() << " ms" << std::endl;
+}
+
+// marks the files named by the events in buffer, an overflowed queue marks every file
+static void read_events(const char* buffer, ssize_t size, std::unordered_map<int, std::vector<size_t>>& watches,
+                        std::vector<WatchedFile>& files, std::vector<bool>& changed) {
+    for (const char* pos = buffer; pos < buffer + size;) {
+        const inotify_event* event = reinterpret_cast<const inotify_event*>(pos);
+        pos += sizeof(inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+            changed.assign(files.size(), true);
+            continue;
+        }
+
+        if (event->len == 0 || !(event->mask & WATCH_EVENTS)) {
+            continue;
+        }
+
+        for (const size_t index : watches[event->wd]) {
+            if (files[index].name_ == event->name) {
+                changed[index] = true;
+            }
+        }
+    }
+}
+
+int watch(const std::vector<BatchJob>& jobs, const BatchOptions& options, std::ostream& log) {
+    const int fd = inotify_init1(IN_CLOEXEC);
+
+    if (fd < 0) {
+        log << "Failed to start watching: " << strerror(errno) << '\n';
+        return 1;
+    }
+
+    std::vector<WatchedFile> files(jobs.size());
+
+    // wd to the files in that directory, several paths to one directory share a wd
+    std::unordered_map<int, std::vector<size_t>> watches;
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const std::filesystem::path input { jobs[i].input_ };
+
+        if (jobs[i].input_ == "-") {
+            log << "Standard input can not be watched" << '\n';
+            close(fd);
+            return 1;
+        }
+
+        // editors often save by renaming a new file over the old one, so the directory is watched rather than the file
+        const std::string directory = input.has_parent_path() ? input.parent_path().string() : ".";
+        const int wd = inotify_add_watch(fd, directory.c_str(), WATCH_EVENTS);
+
+        if (wd < 0) {
+            log << "Failed to watch " << directory << ": " << strerror(errno) << '\n';
+            close(fd);
+            return 1;
+        }
+
+        files[i].job_ = &jobs[i];
+        files[i].name_ = input.filename().string();
+        files[i].compiler_ = std::make_unique<SCompiler>();
+        files[i].compiler_->set_output(options.output_type_);
+        files[i].compiler_->set_format(options.format_);
+        files[i].compiler_->set_optimize(options.optimize_);
+        files[i].compiler_->set_object(options.object_);
+        files[i].compiler_->set_line_map(options.line_map_);
+        files[i].compiler_->set_cache(options.cache_);
+
+        watches[wd].push_back(i);
+    }
+
+    for (WatchedFile& file : files) {
+        rebuild(file, log);
+    }
+
+    log << "watching " << files.size() << (files.size() == 1 ? " file" : " files") << ", ctrl-c to stop" << std::endl;
+
+    alignas(inotify_event) char buffer[16 * 1024];
+    std::vector<bool> changed(files.size(), false);
+
+    while (true) {
+        ssize_t size = read(fd, buffer, sizeof(buffer));
+
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            log << "Failed to read file events: " << strerror(errno) << '\n';
+            close(fd);
+            return 1;
+        }
+
+        read_events(buffer, size, watches, files, changed);
+
+        // a save can take several events, take everything already queued so each file is built once
+        pollfd pending { fd, POLLIN, 0 };
+
+        while (poll(&pending, 1, 0) > 0 && (size = read(fd, buffer, sizeof(buffer))) > 0) {
+            read_events(buffer, size, watches, files, changed);
+        }
+
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (changed[i]) {
+                changed[i] = false;
+                rebuild(files[i], log);
+            }
+        }
+    }
+}
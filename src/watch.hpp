@@ -0,0 +1,15 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include "batch.hpp"
+
+/*
+ * Compiles every job once, then waits on inotify for inputs to be saved and recompiles only the
+ * files that changed. Each file keeps its compiler (and the arena behind it) between rebuilds,
+ * and images are written to a temporary file and renamed, so nothing reading them ever sees a
+ * half written image. A failed rebuild leaves the previous images in place. Runs until killed,
+ * returns 1 when the inputs cannot be watched.
+ */
+int watch(const std::vector<BatchJob>& jobs, const BatchOptions& options, std::ostream& log);
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/batch_emu.hpp"
+
+// the same hash as InstanceResult::ram_hash_, fnv-1a of the address and value of every non zero ram word
+static uint64_t ram_hash(const CpuState& state) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (size_t address = 0; address < state.ram_.size(); ++address) {
+        if (state.ram_[address] != 0) {
+            hash = (hash ^ address) * 0x100000001B3ull;
+            hash = (hash ^ state.ram_[address]) * 0x100000001B3ull;
+        }
+    }
+
+    return hash;
+}
+
+// runs every vector of a batch again on its own and checks that both stop in the same state
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        std::cout << "Usage: " << argv[0] << " <image> <vectors> <cycles>" << std::endl;
+        return 1;
+    }
+
+    const std::vector<std::string> files { argv[1] };
+    const uint64_t max_cycles = std::stoull(argv[3]);
+
+    OutputTypes type;
+    std::vector<Word> rom;
+    std::vector<TestVector> vectors;
+    std::string error;
+
+    if (!detect_rom_type(files, type, error) || !load_rom(files, type, rom, error) || !read_vectors(argv[2], vectors, error)) {
+        std::cout << error << std::endl;
+        return 1;
+    }
+
+    Emulator emulator;
+    emulator.load(rom);
+
+    const BatchReport report = BatchEmulator(emulator).run(vectors, max_cycles, 0);
+    size_t failed = 0;
+
+    for (size_t i = 0; i < vectors.size(); ++i) {
+        emulator.reset();
+
+        for (const auto& [reg, value] : vectors[i].registers_) {
+            emulator.state().regs_[reg] = value;
+        }
+
+        for (const auto& [address, value] : vectors[i].ram_) {
+            emulator.state().ram_[address] = value;
+        }
+
+        emulator.run(max_cycles);
+
+        const CpuState& state = emulator.state();
+        const InstanceResult& result = report.instances_[i];
+
+        const bool same = state.regs_ == result.regs_ && state.pc_ == result.pc_ && state.cycles_ == result.cycles_
+            && state.reason_ == result.reason_ && ram_hash(state) == result.ram_hash_;
+
+        if (!same) {
+            std::cout << "line " << vectors[i].line_ << ": batch stopped with " << halt_reason_name(result.reason_) << " after " << result.cycles_
+                      << " cycles, alone with " << halt_reason_name(state.reason_) << " after " << state.cycles_ << " cycles" << '\n';
+            ++failed;
+        }
+    }
+
+    std::cout << vectors.size() - failed << " of " << vectors.size() << " instances match" << std::endl;
+
+    return failed == 0 ? 0 : 1;
+}